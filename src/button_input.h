@@ -0,0 +1,167 @@
+#pragma once
+
+#include <OneButton.h>
+#include <SPI.h>
+
+// Footswitch input backends: scan() samples all the inputs at once,
+// isPressed() returns the state of a button as seen by the last scan,
+// anyPressed() whether any button was, before debouncing.
+
+// One GPIO per button, active LOW with internal pull-up
+template <uint8_t N>
+class GPIOButtonInput
+{
+public:
+    explicit GPIOButtonInput(const uint8_t *pins) : pins(pins) {}
+
+    void begin()
+    {
+        for (uint8_t i = 0; i < N; i++)
+        {
+            pinMode(pins[i], INPUT_PULLUP);
+        }
+    }
+
+    void scan()
+    {
+        for (uint8_t i = 0; i < N; i++)
+        {
+            pressed[i] = digitalRead(pins[i]) == LOW;
+        }
+    }
+
+    bool isPressed(uint8_t i) const
+    {
+        return pressed[i];
+    }
+
+    bool anyPressed() const
+    {
+        for (uint8_t i = 0; i < N; i++)
+        {
+            if (pressed[i])
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    const uint8_t *pins;
+    bool pressed[N] = {};
+};
+
+// Chained 74HC165 shift registers read over HSPI in a single burst.
+// SH/LD goes to loadPin, CLK to SCK (D5), QH of the last register to MISO (D6), CLK INH to GND.
+// Inputs are active LOW with external pull-ups: button 1 is input A of the register wired to MISO,
+// button 9 is input A of the next register in the chain and so on.
+template <uint8_t N>
+class ShiftRegisterButtonInput
+{
+public:
+    explicit ShiftRegisterButtonInput(uint8_t loadPin) : loadPin(loadPin) {}
+
+    void begin()
+    {
+        pinMode(loadPin, OUTPUT);
+        digitalWrite(loadPin, HIGH);
+        SPI.begin();
+    }
+
+    void scan()
+    {
+        // Latch all the parallel inputs, then shift them out
+        digitalWrite(loadPin, LOW);
+        digitalWrite(loadPin, HIGH);
+
+        SPI.beginTransaction(SPISettings(SHIFT_REGISTER_SPI_FREQUENCY, MSBFIRST, SPI_MODE0));
+        SPI.transfer(state, sizeof(state));
+        SPI.endTransaction();
+    }
+
+    bool isPressed(uint8_t i) const
+    {
+        return !(state[i / 8] & (1 << (i % 8)));
+    }
+
+    // A byte at a time, the inputs past button N are ignored
+    bool anyPressed() const
+    {
+        for (uint8_t i = 0; i < sizeof(state); i++)
+        {
+            const uint8_t mask = i < N / 8 ? 0xFF : (1 << (N % 8)) - 1;
+            if (~state[i] & mask)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    const uint8_t loadPin;
+    uint8_t state[(N + 7) / 8] = {};
+};
+
+// N footswitches read through an input backend and debounced by OneButton
+template <uint8_t N, template <uint8_t> class Input>
+class ButtonScanner
+{
+public:
+    template <typename... Args>
+    explicit ButtonScanner(Args... args) : input(args...)
+    {
+    }
+
+    void begin()
+    {
+        input.begin();
+    }
+
+    void tick()
+    {
+        input.scan();
+        for (uint8_t i = 0; i < N; i++)
+        {
+            buttons[i].tick(input.isPressed(i));
+        }
+    }
+
+    // No button is pressed or waiting for a multiple click
+    bool isIdle() const
+    {
+        for (uint8_t i = 0; i < N; i++)
+        {
+            if (!buttons[i].isIdle())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Raw input of the last scan: a press is seen before OneButton has debounced it,
+    // and debouncing runs on millis(), which stops during light sleep
+    bool anyPressed() const
+    {
+        return input.anyPressed();
+    }
+
+    // Raw input of button i in the last scan
+    bool isPressed(uint8_t i) const
+    {
+        return input.isPressed(i);
+    }
+
+    OneButton &operator[](uint8_t i)
+    {
+        return buttons[i];
+    }
+
+    static constexpr uint8_t count = N;
+
+private:
+    Input<N> input;
+    OneButton buttons[N];
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+// The whole buttons configuration as one compact JSON document:
+// {"buttons":[{"push":"CC 1 80 127,CC 1 80 0","hold":"","doublePush":"","repeatOnHold":false,
+//              "var":{"min":0,"max":127,"value":0,"step":1}}, ...]}
+
+#include <ArduinoJson.h>
+
+// Stream the configuration document, no intermediate buffer is built. Without values, the
+// VAR values are left out: they are live state, changed by the VAR_INC and VAR_DEC commands
+template <uint8_t N>
+void printConfigDocument(Print &out, const MIDIButtonCommands *buttons, bool values = true)
+{
+    out.print("{\"buttons\":[");
+    for (uint8_t i = 0; i < N; i++)
+    {
+        const MIDIButtonCommands &button = buttons[i];
+        if (i > 0)
+        {
+            out.print(',');
+        }
+        // Command lists never contain characters that need escaping
+        out.print("{\"push\":\"");
+        button.push.printTo(out);
+        out.print("\",\"hold\":\"");
+        button.hold.printTo(out);
+        out.print("\",\"doublePush\":\"");
+        button.doublePush.printTo(out);
+        out.print("\",\"repeatOnHold\":");
+        out.print(button.flags.repeatOnHold ? "true" : "false");
+        out.print(",\"var\":{\"min\":");
+        out.print(button.var.min);
+        out.print(",\"max\":");
+        out.print(button.var.max);
+        if (values)
+        {
+            out.print(",\"value\":");
+            out.print(button.var.value);
+        }
+        out.print(",\"step\":");
+        out.print(button.var.step);
+        out.print("}}");
+    }
+    out.print("]}");
+}
+
+// Validate a configuration document (dryRun) or copy it into the buttons, which expects a validated document.
+// Buttons missing from the document are left as they are. Returns an error message, empty if valid.
+template <uint8_t N>
+String applyConfigDocument(JsonVariantConst document, MIDIButtonCommands *buttons, bool dryRun)
+{
+    JsonArrayConst buttonsArray = document["buttons"];
+    if (buttonsArray.isNull())
+    {
+        return "Missing buttons";
+    }
+    if (buttonsArray.size() > N)
+    {
+        return "Too many buttons";
+    }
+
+    uint8_t i = 0;
+    for (JsonObjectConst buttonObject : buttonsArray)
+    {
+        MDIDIButtonVar var;
+        var.min = buttonObject["var"]["min"] | var.min;
+        var.max = buttonObject["var"]["max"] | var.max;
+        var.value = buttonObject["var"]["value"] | var.value;
+        var.step = buttonObject["var"]["step"] | var.step;
+
+        if (var.min > var.max || var.step < 1)
+        {
+            return "Invalid VAR range for button " + String(i + 1);
+        }
+
+        if (dryRun)
+        {
+            // Parsed one list at a time, the handlers run on a small stack
+            bool valid = !buttonObject.isNull();
+            parseMIDICommands(buttonObject["push"] | "", &valid);
+            parseMIDICommands(buttonObject["hold"] | "", &valid);
+            parseMIDICommands(buttonObject["doublePush"] | "", &valid);
+            if (!valid)
+            {
+                return "Invalid MIDI commands for button " + String(i + 1);
+            }
+        }
+        else
+        {
+            MIDIButtonCommands &button = buttons[i];
+            button.push = parseMIDICommands(buttonObject["push"] | "");
+            button.hold = parseMIDICommands(buttonObject["hold"] | "");
+            button.doublePush = parseMIDICommands(buttonObject["doublePush"] | "");
+            button.flags.repeatOnHold = buttonObject["repeatOnHold"] | false;
+            button.var = var;
+        }
+        i++;
+    }
+
+    return String();
+}
+
+// FNV-1a hash of everything printed to it
+class HashPrint : public Print
+{
+public:
+    size_t write(uint8_t byte) override
+    {
+        hash = (hash ^ byte) * 16777619;
+        return 1;
+    }
+
+    uint32_t hash = 2166136261;
+};
+
+// Hash of the configuration document as served by GET /config without the VAR values, so
+// playing the pedal doesn't change it. A provisioning script gets the same value hashing a
+// document saved from GET /config, rendered without the values too
+template <uint8_t N>
+uint32_t configDocumentHash(const MIDIButtonCommands *buttons)
+{
+    HashPrint hashPrint;
+    printConfigDocument<N>(hashPrint, buttons, false);
+    return hashPrint.hash;
+}
@@ -0,0 +1,486 @@
+#pragma once
+
+// Log-structured store for the buttons configuration and VAR values.
+// Every change is appended to <path>.log as a small checksummed record:
+//   0xA5, type, button, payload length (2 bytes LE), payload, CRC-16 of type to payload (2 bytes LE)
+// Bit 7 of the type marks the last record of a transaction. At boot the journal is
+// replayed up to the last complete transaction, so a power cut in the middle of a
+// save leaves the previous configuration in place, and the incomplete tail is cut
+// before anything else is appended. When the journal grows past JOURNAL_COMPACT_SIZE and
+// twice the size of the last snapshot, it is rewritten from loop() as a snapshot of the
+// current state into <path>.tmp, which then replaces the journal.
+
+#define JOURNAL_PATH "/journal"
+#define JOURNAL_COMPACT_SIZE 4096
+
+const uint8_t JOURNAL_MAGIC = 0xA5;
+const uint8_t JOURNAL_COMMIT = 0x80;
+
+// Record types
+const uint8_t JOURNAL_PUSH = 1;        // Command list as text
+const uint8_t JOURNAL_HOLD = 2;        // Command list as text
+const uint8_t JOURNAL_DOUBLE_PUSH = 3; // Command list as text
+const uint8_t JOURNAL_FLAGS = 4;       // Flags as text
+const uint8_t JOURNAL_VAR = 5;         // Value, min, max and step as 4 bytes LE each
+
+// CRC-16/CCITT
+uint16_t crc16(uint16_t crc, const uint8_t *data, size_t length)
+{
+    while (length--)
+    {
+        crc ^= (uint16_t)*data++ << 8;
+        for (uint8_t i = 0; i < 8; i++)
+        {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+// Writes a record payload to the journal file in small chunks and computes its CRC on the way
+class JournalPayloadPrint : public Print
+{
+public:
+    JournalPayloadPrint(File &file, uint16_t crc) : file(file), crc(crc)
+    {
+    }
+
+    size_t write(uint8_t byte) override
+    {
+        chunk[chunkLength++] = byte;
+        if (chunkLength == sizeof(chunk))
+        {
+            flush();
+        }
+        return 1;
+    }
+
+    void flush() override
+    {
+        crc = crc16(crc, chunk, chunkLength);
+        written += file.write(chunk, chunkLength);
+        chunkLength = 0;
+    }
+
+    File &file;
+    uint16_t crc;
+    size_t written = 0;
+
+private:
+    uint8_t chunk[32];
+    uint8_t chunkLength = 0;
+};
+
+template <uint8_t N>
+class ConfigJournal
+{
+public:
+    ConfigJournal(MIDIButtonCommands *buttons, fs::FS &fs, const String &path = JOURNAL_PATH)
+        : buttons(buttons), fs(fs), journalFile(path + ".log"), tmpFile(path + ".tmp")
+    {
+    }
+
+    // Replay the journal into the buttons, returns false if there is no journal yet
+    bool load()
+    {
+        if (!fs.exists(journalFile))
+        {
+            // A compaction interrupted after removing the old journal left a snapshot. Only a
+            // complete one, ending with the commit record of the last button, replaces it
+            if (!fs.exists(tmpFile) || !isCommitted(tmpFile))
+            {
+                fs.remove(tmpFile);
+                return false;
+            }
+            fs.rename(tmpFile, journalFile);
+        }
+        else if (fs.exists(tmpFile))
+        {
+            fs.remove(tmpFile);
+        }
+
+        File file = fs.open(journalFile, "r+");
+        if (!file)
+        {
+            logError("Failed to open file " + journalFile + " for reading");
+            return false;
+        }
+
+        // First pass: find the end of the last complete transaction
+        const size_t committedEnd = committedLength(file);
+
+        // Second pass: apply the committed records
+        file.seek(0, SeekSet);
+        uint8_t type;
+        uint8_t index;
+        uint16_t length;
+        while (file.position() < committedEnd && readRecordHeader(file, type, index, length))
+        {
+            applyRecord(file, type & ~JOURNAL_COMMIT, index, length);
+            file.seek(2, SeekCur);
+        }
+
+        const size_t fileSize = file.size();
+
+#ifdef DEBUG
+        Serial.println("Journal replayed " + String(committedEnd) + " of " + String(fileSize) + " bytes");
+#endif
+
+        // Drop an incomplete tail now, records appended after it would never be replayed
+        const bool truncated = committedEnd == fileSize || file.truncate(committedEnd);
+        file.close();
+        if (!truncated)
+        {
+            // Rewrite the journal before anything is appended to it
+            compact();
+            while (isCompacting())
+            {
+                update();
+            }
+        }
+
+        return true;
+    }
+
+    // Append the whole configuration of a button, commit closes the transaction
+    void saveButton(uint8_t index, bool commit = true)
+    {
+        File file = openJournal();
+        if (file)
+        {
+            writeButton(file, index, commit);
+            closeJournal(file);
+        }
+    }
+
+    // Append the VAR values of a button as a transaction of its own
+    void saveVar(uint8_t index)
+    {
+        File file = openJournal();
+        if (file)
+        {
+            writeVar(file, index, JOURNAL_COMMIT);
+            closeJournal(file);
+        }
+    }
+
+    // Schedule a rewrite of the journal as a snapshot of the current configuration
+    void compact()
+    {
+        if (compactionFile)
+        {
+            compactionFile.close();
+        }
+        compactionStep = 0;
+    }
+
+    // Run one compaction step (one button) if one is scheduled, call it from loop()
+    void update()
+    {
+        if (compactionStep < 0)
+        {
+            return;
+        }
+
+        if (compactionStep == 0)
+        {
+            compactionFile = fs.open(tmpFile, "w");
+            if (!compactionFile)
+            {
+                logError("Failed to open file " + tmpFile + " for writing");
+                compactionStep = -1;
+                return;
+            }
+        }
+
+        if (compactionStep < N)
+        {
+            writeButton(compactionFile, compactionStep, compactionStep == N - 1);
+            compactionStep++;
+            return;
+        }
+
+        snapshotSize = compactionFile.size();
+        compactionFile.close();
+        fs.remove(journalFile);
+        fs.rename(tmpFile, journalFile);
+        compactionStep = -1;
+        compactions++;
+
+#ifdef DEBUG
+        Serial.println("Journal compacted, " + String(compactions) + " compactions, " + String(bytesWritten) + " bytes written");
+#endif
+    }
+
+    bool isCompacting() const
+    {
+        return compactionStep >= 0;
+    }
+
+    // Write statistics, including compactions
+    uint32_t bytesWritten = 0;
+    uint32_t compactions = 0;
+
+private:
+    MIDIButtonCommands *buttons;
+    fs::FS &fs;
+    const String journalFile;
+    const String tmpFile;
+    // Next button to write in the snapshot, -1 when no compaction is running
+    int compactionStep = -1;
+    File compactionFile;
+    // Size of the last snapshot written, unknown (0) until the first compaction after boot
+    size_t snapshotSize = 0;
+
+    File openJournal()
+    {
+        File file = fs.open(journalFile, "a");
+        if (!file)
+        {
+            logError("Failed to open file " + journalFile + " for writing");
+        }
+        return file;
+    }
+
+    void closeJournal(File &file)
+    {
+        const size_t size = file.size();
+        file.close();
+
+        // Compact once the records appended since the snapshot are as large as it, so a large
+        // configuration isn't rewritten on every change. A running compaction has missed
+        // this change: start it over
+        if (size > max((size_t)JOURNAL_COMPACT_SIZE, 2 * snapshotSize) || compactionStep > 0)
+        {
+            compact();
+        }
+    }
+
+    // Length of the records up to the last commit record with a valid CRC, 0 if there is none
+    size_t committedLength(File &file)
+    {
+        size_t committedEnd = 0;
+        uint8_t type;
+        uint8_t index;
+        uint16_t length;
+        while (readRecordHeader(file, type, index, length))
+        {
+            uint8_t header[4] = {type, index, (uint8_t)length, (uint8_t)(length >> 8)};
+            uint16_t crc = crc16(0xFFFF, header, sizeof(header));
+            uint8_t chunk[64];
+            while (length > 0)
+            {
+                const size_t count = file.read(chunk, min(length, (uint16_t)sizeof(chunk)));
+                if (count == 0)
+                {
+                    break;
+                }
+                crc = crc16(crc, chunk, count);
+                length -= count;
+            }
+            uint8_t storedCrc[2];
+            if (length > 0 || file.read(storedCrc, 2) != 2 || crc != (storedCrc[0] | storedCrc[1] << 8))
+            {
+                break;
+            }
+            if (type & JOURNAL_COMMIT)
+            {
+                committedEnd = file.position();
+            }
+        }
+        return committedEnd;
+    }
+
+    bool isCommitted(const String &path)
+    {
+        File file = fs.open(path, "r");
+        if (!file)
+        {
+            return false;
+        }
+        const bool committed = committedLength(file) > 0;
+        file.close();
+        return committed;
+    }
+
+    bool readRecordHeader(File &file, uint8_t &type, uint8_t &index, uint16_t &length)
+    {
+        uint8_t header[5];
+        if (file.read(header, sizeof(header)) != sizeof(header) || header[0] != JOURNAL_MAGIC)
+        {
+            return false;
+        }
+        type = header[1];
+        index = header[2];
+        length = header[3] | header[4] << 8;
+        return true;
+    }
+
+    void applyRecord(File &file, uint8_t type, uint8_t index, uint16_t length)
+    {
+        // Records of buttons this board doesn't have are skipped
+        if (index >= N)
+        {
+            file.seek(length, SeekCur);
+            return;
+        }
+
+        MIDIButtonCommands &button = buttons[index];
+        if (type == JOURNAL_VAR && length == 16)
+        {
+            uint8_t payload[16];
+            file.read(payload, sizeof(payload));
+            button.var.value = readInt(payload);
+            button.var.min = readInt(payload + 4);
+            button.var.max = readInt(payload + 8);
+            button.var.step = readInt(payload + 12);
+            return;
+        }
+
+        String text;
+        text.reserve(length);
+        for (uint16_t i = 0; i < length; i++)
+        {
+            text += (char)file.read();
+        }
+
+        switch (type)
+        {
+        case JOURNAL_PUSH:
+            button.push = parseMIDICommands(text);
+            break;
+        case JOURNAL_HOLD:
+            button.hold = parseMIDICommands(text);
+            break;
+        case JOURNAL_DOUBLE_PUSH:
+            button.doublePush = parseMIDICommands(text);
+            break;
+        case JOURNAL_FLAGS:
+            button.flags.fromString(text);
+            break;
+        }
+    }
+
+    size_t writeRecord(File &file, uint8_t type, uint8_t index, const uint8_t *payload, uint16_t length)
+    {
+        const uint8_t header[5] = {JOURNAL_MAGIC, type, index, (uint8_t)length, (uint8_t)(length >> 8)};
+        const uint16_t crc = crc16(crc16(0xFFFF, header + 1, sizeof(header) - 1), payload, length);
+        const uint8_t trailer[2] = {(uint8_t)crc, (uint8_t)(crc >> 8)};
+
+        size_t written = file.write(header, sizeof(header));
+        written += file.write(payload, length);
+        written += file.write(trailer, sizeof(trailer));
+        bytesWritten += written;
+        return written;
+    }
+
+    // Command lists are printed straight to the file: a first pass sizes the record
+    size_t writeCommands(File &file, uint8_t type, uint8_t index, const MIDICommandList &commandList)
+    {
+        CountPrint countPrint;
+        const uint16_t length = commandList.printTo(countPrint);
+        const uint8_t header[5] = {JOURNAL_MAGIC, type, index, (uint8_t)length, (uint8_t)(length >> 8)};
+
+        size_t written = file.write(header, sizeof(header));
+        JournalPayloadPrint payload(file, crc16(0xFFFF, header + 1, sizeof(header) - 1));
+        commandList.printTo(payload);
+        payload.flush();
+        const uint8_t trailer[2] = {(uint8_t)payload.crc, (uint8_t)(payload.crc >> 8)};
+        written += payload.written;
+        written += file.write(trailer, sizeof(trailer));
+        bytesWritten += written;
+        return written;
+    }
+
+    size_t writeText(File &file, uint8_t type, uint8_t index, const String &text)
+    {
+        return writeRecord(file, type, index, (const uint8_t *)text.c_str(), text.length());
+    }
+
+    size_t writeVar(File &file, uint8_t index, uint8_t commit)
+    {
+        const MDIDIButtonVar &var = buttons[index].var;
+        uint8_t payload[16];
+        writeInt(payload, var.value);
+        writeInt(payload + 4, var.min);
+        writeInt(payload + 8, var.max);
+        writeInt(payload + 12, var.step);
+        return writeRecord(file, JOURNAL_VAR | commit, index, payload, sizeof(payload));
+    }
+
+    size_t writeButton(File &file, uint8_t index, bool commit)
+    {
+        const MIDIButtonCommands &button = buttons[index];
+        size_t written = writeCommands(file, JOURNAL_PUSH, index, button.push);
+        written += writeCommands(file, JOURNAL_HOLD, index, button.hold);
+        written += writeCommands(file, JOURNAL_DOUBLE_PUSH, index, button.doublePush);
+        written += writeText(file, JOURNAL_FLAGS, index, button.flags.toString());
+        written += writeVar(file, index, commit ? JOURNAL_COMMIT : 0);
+        return written;
+    }
+
+    static int32_t readInt(const uint8_t *bytes)
+    {
+        return (int32_t)(bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24);
+    }
+
+    static void writeInt(uint8_t *bytes, int32_t value)
+    {
+        for (uint8_t i = 0; i < 4; i++)
+        {
+            bytes[i] = value >> (8 * i);
+        }
+    }
+};
+
+#ifdef STORAGE_BENCHMARK
+// Time the /set save sequence, the boot load, a compaction and a web asset read on a storage
+// backend. A separate journal path is used, the live configuration is left untouched.
+template <uint8_t N>
+void benchmarkStorage(const char *name, fs::FS &fs, MIDIButtonCommands *buttons)
+{
+    const String path = "/benchmark";
+    MIDIButtonCommands *loaded = new MIDIButtonCommands[N];
+    ConfigJournal<N> journal(buttons, fs, path);
+
+    unsigned long start = micros();
+    File file = fs.open(WEB_ROOT "/index.html.gz", "r");
+    const unsigned long openUs = micros() - start;
+
+    start = micros();
+    uint8_t chunk[256];
+    size_t assetBytes = 0;
+    while (file && file.available())
+    {
+        assetBytes += file.read(chunk, sizeof(chunk));
+    }
+    file.close();
+    const unsigned long assetUs = micros() - start;
+
+    start = micros();
+    for (uint8_t i = 0; i < N; i++)
+    {
+        journal.saveButton(i, i == N - 1);
+    }
+    const unsigned long saveUs = micros() - start;
+
+    start = micros();
+    ConfigJournal<N>(loaded, fs, path).load();
+    const unsigned long loadUs = micros() - start;
+
+    start = micros();
+    journal.compact();
+    while (journal.isCompacting())
+    {
+        journal.update();
+    }
+    const unsigned long compactUs = micros() - start;
+
+    fs.remove(path + ".log");
+    delete[] loaded;
+
+    Serial.println(String("Storage ") + name + ": open " + String(openUs) + " us, read " + String(assetBytes) + " bytes " +
+                   String(assetUs) + " us, save " + String(saveUs) + " us, load " + String(loadUs) + " us, compact " +
+                   String(compactUs) + " us, " + String(journal.bytesWritten) + " bytes written");
+}
+#endif
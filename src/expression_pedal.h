@@ -0,0 +1,144 @@
+#pragma once
+
+// Expression pedal on the analog input, sent as a CC (or a 14-bit CC pair).
+// Every EXPRESSION_SAMPLE_INTERVAL_MS the ADC is read EXPRESSION_OVERSAMPLING times, the sum
+// is smoothed by an exponential moving average in fixed point (weight 1/2^EXPRESSION_FILTER_SHIFT)
+// and mapped to 14 bits between EXPRESSION_ADC_MIN and EXPRESSION_ADC_MAX. A new value is only
+// taken when the position is EXPRESSION_HYSTERESIS (14-bit units) past the edges of the current
+// value, so noise around an edge doesn't toggle it. Messages are sent at most every
+// EXPRESSION_MIN_INTERVAL_MS and only when the MIDI ports have sent everything queued: while
+// they are busy only the latest value is kept, older ones are dropped. The ends of the travel bypass the hysteresis.
+
+#ifndef EXPRESSION_PIN
+#define EXPRESSION_PIN A0
+#endif
+#ifndef EXPRESSION_CHANNEL
+#define EXPRESSION_CHANNEL 1
+#endif
+// 0-31 with EXPRESSION_14BIT, the LSB is sent on EXPRESSION_CC + 32
+#ifndef EXPRESSION_CC
+#define EXPRESSION_CC 11
+#endif
+// MIDI_PORT_* bits the pedal is sent to
+#ifndef EXPRESSION_PORTS
+#define EXPRESSION_PORTS MIDI_DEFAULT_PORTS
+#endif
+// An analogRead() takes about 100 us: 4 readings every 10 ms keep the ADC under 5% of loop()
+#ifndef EXPRESSION_SAMPLE_INTERVAL_MS
+#define EXPRESSION_SAMPLE_INTERVAL_MS 10
+#endif
+#ifndef EXPRESSION_OVERSAMPLING
+#define EXPRESSION_OVERSAMPLING 4
+#endif
+// Weight 1/2 at 10 ms: 94% of a step after 40 ms (1 - 1/2^4), 99% after 70 ms
+#ifndef EXPRESSION_FILTER_SHIFT
+#define EXPRESSION_FILTER_SHIFT 1
+#endif
+// Pedal travel on the 10-bit ADC, the ends are clamped so the full range is always reached
+#ifndef EXPRESSION_ADC_MIN
+#define EXPRESSION_ADC_MIN 16
+#endif
+#ifndef EXPRESSION_ADC_MAX
+#define EXPRESSION_ADC_MAX 1008
+#endif
+#ifndef EXPRESSION_HYSTERESIS
+#define EXPRESSION_HYSTERESIS 48
+#endif
+#ifndef EXPRESSION_MIN_INTERVAL_MS
+#define EXPRESSION_MIN_INTERVAL_MS 5
+#endif
+
+#ifdef EXPRESSION_14BIT
+static_assert(EXPRESSION_CC <= 31, "A 14-bit expression CC must be between 0 and 31");
+const uint8_t EXPRESSION_VALUE_SHIFT = 0; // 14-bit values
+#else
+static_assert(EXPRESSION_CC <= 127, "Invalid expression CC");
+const uint8_t EXPRESSION_VALUE_SHIFT = 7; // 7-bit values
+#endif
+static_assert(EXPRESSION_ADC_MIN < EXPRESSION_ADC_MAX && EXPRESSION_ADC_MAX <= 1023, "Invalid expression ADC range");
+static_assert(EXPRESSION_HYSTERESIS < (1 << EXPRESSION_VALUE_SHIFT) || EXPRESSION_VALUE_SHIFT == 0,
+              "The expression hysteresis must be smaller than a value step");
+
+class ExpressionPedal
+{
+public:
+    // Call it from loop()
+    void update()
+    {
+        if (millis() - lastSampleMs >= EXPRESSION_SAMPLE_INTERVAL_MS)
+        {
+            lastSampleMs = millis();
+            sample();
+        }
+
+        if (pending && millis() - lastSendMs >= EXPRESSION_MIN_INTERVAL_MS && midiPortsIdle(EXPRESSION_PORTS))
+        {
+            pending = false;
+            lastSendMs = millis();
+#ifdef EXPRESSION_14BIT
+            sendMIDICC14(EXPRESSION_CHANNEL, EXPRESSION_CC, value, EXPRESSION_PORTS);
+#else
+            sendMIDI(CC, EXPRESSION_CHANNEL, EXPRESSION_CC, value, EXPRESSION_PORTS);
+#endif
+            sent++;
+        }
+    }
+
+    // Last value taken, in the output resolution
+    uint16_t value = 0;
+    // Messages sent and values replaced by a newer one before being sent
+    uint32_t sent = 0;
+    uint32_t dropped = 0;
+
+private:
+    // Filtered sum of EXPRESSION_OVERSAMPLING readings, scaled by 2^EXPRESSION_FILTER_SHIFT
+    uint32_t filter = 0;
+    bool started = false;
+    bool pending = false;
+    unsigned long lastSampleMs = 0;
+    unsigned long lastSendMs = 0;
+
+    void sample()
+    {
+        uint32_t sum = 0;
+        for (uint8_t i = 0; i < EXPRESSION_OVERSAMPLING; i++)
+        {
+            sum += analogRead(EXPRESSION_PIN);
+        }
+
+        if (!started)
+        {
+            filter = sum << EXPRESSION_FILTER_SHIFT;
+        }
+        filter = filter - (filter >> EXPRESSION_FILTER_SHIFT) + sum;
+
+        // Position on 14 bits over the pedal travel
+        const int32_t lowest = (int32_t)EXPRESSION_ADC_MIN * EXPRESSION_OVERSAMPLING;
+        const int32_t highest = (int32_t)EXPRESSION_ADC_MAX * EXPRESSION_OVERSAMPLING;
+        const int32_t filtered = filter >> EXPRESSION_FILTER_SHIFT;
+        const uint16_t position = (constrain(filtered, lowest, highest) - lowest) * 16383 / (highest - lowest);
+
+        // Edges of the current value, widened by the hysteresis
+        const int32_t low = ((int32_t)value << EXPRESSION_VALUE_SHIFT) - EXPRESSION_HYSTERESIS;
+        const int32_t high = (((int32_t)value + 1) << EXPRESSION_VALUE_SHIFT) - 1 + EXPRESSION_HYSTERESIS;
+        // The ends of the travel are always reached
+        const bool end = position == 0 || position == 16383;
+        if (started && !end && position >= low && position <= high)
+        {
+            return;
+        }
+
+        const uint16_t newValue = position >> EXPRESSION_VALUE_SHIFT;
+        if (started && newValue == value)
+        {
+            return;
+        }
+        if (pending)
+        {
+            dropped++;
+        }
+        started = true;
+        value = newValue;
+        pending = true;
+    }
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+// Heap instrumentation, to spot fragmentation on long uptimes.
+// The heap is sampled before and after each HTTP request and each command list sent,
+// GET /heap reports the current values and the low-water marks of each site.
+
+// Where the heap is sampled
+enum HeapSite : uint8_t
+{
+    HEAP_BOOT,
+    HEAP_HTTP,
+    HEAP_MIDI_SEND,
+    HEAP_SITE_COUNT
+};
+
+const char *const HEAP_SITE_NAMES[HEAP_SITE_COUNT] = {"boot", "http", "midiSend"};
+
+// Worst values seen at a site
+struct HeapLowWater
+{
+    uint32_t minFreeHeap = UINT32_MAX;
+    uint32_t minMaxBlock = UINT32_MAX;
+    uint8_t maxFragmentation = 0;
+    uint32_t samples = 0;
+};
+
+HeapLowWater heapLowWater[HEAP_SITE_COUNT];
+
+void sampleHeap(HeapSite site)
+{
+    HeapLowWater &lowWater = heapLowWater[site];
+    lowWater.minFreeHeap = min(lowWater.minFreeHeap, ESP.getFreeHeap());
+    lowWater.minMaxBlock = min(lowWater.minMaxBlock, ESP.getMaxFreeBlockSize());
+    lowWater.maxFragmentation = max(lowWater.maxFragmentation, ESP.getHeapFragmentation());
+    lowWater.samples++;
+}
+
+// {"freeHeap":..,"maxBlock":..,"fragmentation":..,"sites":{"http":{"minFreeHeap":..,"minMaxBlock":..,"maxFragmentation":..,"samples":..}, ...}}
+void printHeapStats(Print &out)
+{
+    out.print("{\"freeHeap\":");
+    out.print(ESP.getFreeHeap());
+    out.print(",\"maxBlock\":");
+    out.print(ESP.getMaxFreeBlockSize());
+    out.print(",\"fragmentation\":");
+    out.print(ESP.getHeapFragmentation());
+    out.print(",\"sites\":{");
+    for (uint8_t i = 0; i < HEAP_SITE_COUNT; i++)
+    {
+        const HeapLowWater &lowWater = heapLowWater[i];
+        if (i > 0)
+        {
+            out.print(',');
+        }
+        out.print('"');
+        out.print(HEAP_SITE_NAMES[i]);
+        out.print("\":{\"minFreeHeap\":");
+        out.print(lowWater.samples ? lowWater.minFreeHeap : 0);
+        out.print(",\"minMaxBlock\":");
+        out.print(lowWater.samples ? lowWater.minMaxBlock : 0);
+        out.print(",\"maxFragmentation\":");
+        out.print(lowWater.maxFragmentation);
+        out.print(",\"samples\":");
+        out.print(lowWater.samples);
+        out.print('}');
+    }
+    out.print("}}");
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+// Forced light sleep between footswitch events, for battery powered pedals. The CPU and
+// the UARTs stop for at most LIGHT_SLEEP_SLICE_MS, the footswitches are scanned between
+// two slices so a press is seen at most one slice late. With LIGHT_SLEEP_WAKE_PIN, a GPIO
+// pulled LOW by any footswitch (e.g. through one diode per button), a press ends the
+// slice at once. millis() doesn't advance while sleeping: the sleep time is measured with
+// the RTC, and since the pedal only sleeps when all the footswitches are idle, every
+// gesture is timed from the first scan after the wake.
+// The wake latency is the longest time a press can wait for a scan: the slice as measured
+// by the RTC, or the resume time after a GPIO wake. Above LIGHT_SLEEP_MAX_WAKE_LATENCY_MS
+// the sleep is turned off until the next boot.
+
+extern "C"
+{
+#include "user_interface.h"
+#include "gpio.h"
+}
+#include <coredecls.h>
+
+#ifndef LIGHT_SLEEP_SLICE_MS
+#define LIGHT_SLEEP_SLICE_MS 20
+#endif
+#ifndef LIGHT_SLEEP_MAX_WAKE_LATENCY_MS
+#define LIGHT_SLEEP_MAX_WAKE_LATENCY_MS 30
+#endif
+// Awake time after the last footswitch or MIDI activity, so quick sequences don't pay the wake latency
+#ifndef LIGHT_SLEEP_IDLE_MS
+#define LIGHT_SLEEP_IDLE_MS 2000
+#endif
+
+static_assert(LIGHT_SLEEP_SLICE_MS < LIGHT_SLEEP_MAX_WAKE_LATENCY_MS, "The light sleep slice must be shorter than the wake latency bound");
+#ifdef EXPRESSION_PEDAL
+#error "The expression pedal is sampled continuously, it can't be used with LIGHT_SLEEP"
+#endif
+#ifdef SERIAL_CONFIG_PROTOCOL
+#error "UART0 doesn't receive in light sleep, SERIAL_CONFIG_PROTOCOL can't be used with LIGHT_SLEEP"
+#endif
+#ifdef LIGHT_SLEEP_WAKE_PIN
+static_assert(LIGHT_SLEEP_WAKE_PIN < 16, "GPIO16 can't wake the ESP8266 from light sleep");
+#endif
+
+class LightSleep
+{
+public:
+    // Sleep for at most one slice
+    void sleep()
+    {
+        // The UARTs stop too, let them send what is left in their FIFOs
+        for (uint8_t i = 0; i < MIDI_PORT_COUNT; i++)
+        {
+            if ((1 << i) != MIDI_PORT_NETWORK && isMIDIPortSelected(MIDI_ENABLED_PORTS, i))
+            {
+                midiPortSerial(i).flush();
+            }
+        }
+
+        woken = false;
+        const uint32_t calibration = system_rtc_clock_cali_proc();
+        const uint32_t rtcStart = system_get_rtc_time();
+
+        wifi_fpm_set_sleep_type(LIGHT_SLEEP_T);
+        wifi_fpm_open();
+#ifdef LIGHT_SLEEP_WAKE_PIN
+        gpio_pin_wakeup_enable(GPIO_ID_PIN(LIGHT_SLEEP_WAKE_PIN), GPIO_PIN_INTR_LOLEVEL);
+#endif
+        wifi_fpm_set_wakeup_cb(onWake);
+        wifi_fpm_do_sleep(LIGHT_SLEEP_SLICE_MS * 1000);
+        // The sleep starts when loop() yields, it returns as soon as the wake callback ran
+        esp_delay(LIGHT_SLEEP_SLICE_MS + 1, []() {
+            return !woken;
+        });
+#ifdef LIGHT_SLEEP_WAKE_PIN
+        gpio_pin_wakeup_disable();
+#endif
+        wifi_fpm_close();
+
+        // RTC ticks to microseconds, the calibration is in 1/4096 us per tick
+        const uint32_t sleptUs = ((uint64_t)(system_get_rtc_time() - rtcStart) * calibration) >> 12;
+        const uint32_t resumeUs = micros() - wokenUs;
+        totalSleptUs += sleptUs;
+        slices++;
+
+        // A GPIO wake ends the slice early, the press only waited for the resume
+        const bool gpioWake = sleptUs + 1000 < LIGHT_SLEEP_SLICE_MS * 1000UL;
+        const uint32_t latencyUs = gpioWake ? resumeUs : sleptUs + resumeUs;
+        maxWakeLatencyUs = max(maxWakeLatencyUs, latencyUs);
+        if (latencyUs > LIGHT_SLEEP_MAX_WAKE_LATENCY_MS * 1000UL)
+        {
+            disabled = true;
+        }
+
+        wakeUs = micros();
+        wakeBytesSent = midiBytesSent();
+        waitingFirstByte = true;
+    }
+
+    // Call it from loop() after the footswitches and the MIDI ports are updated
+    void update(bool idle)
+    {
+        // Wake to first MIDI byte, including the gesture: a push is only sent on release
+        if (waitingFirstByte && midiBytesSent() != wakeBytesSent)
+        {
+            waitingFirstByte = false;
+            lastFirstByteUs = micros() - wakeUs;
+            maxFirstByteUs = max(maxFirstByteUs, lastFirstByteUs);
+        }
+
+        if (!idle)
+        {
+            lastActiveMs = millis();
+            active = true;
+        }
+        else if (active)
+        {
+            // The gesture after the wake is over without sending anything
+            active = false;
+            waitingFirstByte = false;
+        }
+    }
+
+    bool canSleep() const
+    {
+        return !disabled && millis() - lastActiveMs > LIGHT_SLEEP_IDLE_MS;
+    }
+
+    // {"slices":..,"sleptMs":..,"maxWakeLatencyUs":..,"lastFirstByteUs":..,"maxFirstByteUs":..,"disabled":..}
+    void print(Print &out) const
+    {
+        out.print("{\"slices\":");
+        out.print(slices);
+        out.print(",\"sleptMs\":");
+        out.print((uint32_t)(totalSleptUs / 1000));
+        out.print(",\"maxWakeLatencyUs\":");
+        out.print(maxWakeLatencyUs);
+        out.print(",\"lastFirstByteUs\":");
+        out.print(lastFirstByteUs);
+        out.print(",\"maxFirstByteUs\":");
+        out.print(maxFirstByteUs);
+        out.print(",\"disabled\":");
+        out.print(disabled ? "true" : "false");
+        out.print('}');
+    }
+
+    uint32_t slices = 0;
+    uint64_t totalSleptUs = 0;
+    uint32_t maxWakeLatencyUs = 0;
+    uint32_t lastFirstByteUs = 0;
+    uint32_t maxFirstByteUs = 0;
+    // Set when a wake took longer than LIGHT_SLEEP_MAX_WAKE_LATENCY_MS
+    bool disabled = false;
+
+private:
+    static volatile bool woken;
+    static volatile uint32_t wokenUs;
+
+    unsigned long lastActiveMs = 0;
+    unsigned long wakeUs = 0;
+    uint32_t wakeBytesSent = 0;
+    bool waitingFirstByte = false;
+    bool active = false;
+
+    static void onWake()
+    {
+        wokenUs = micros();
+        woken = true;
+        esp_schedule();
+    }
+
+    static uint32_t midiBytesSent()
+    {
+        uint32_t bytes = 0;
+        for (uint8_t i = 0; i < MIDI_PORT_COUNT; i++)
+        {
+            bytes += midiPorts[i].bytesSent;
+        }
+        return bytes;
+    }
+};
+
+volatile bool LightSleep::woken = false;
+volatile uint32_t LightSleep::wokenUs = 0;
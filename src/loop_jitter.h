@@ -0,0 +1,53 @@
+#pragma once
+
+// Loop period statistics, kept for each mode (see the performance mode in main.cpp)
+// so the jitter added by the Wi-Fi radio and the web stack can be measured.
+
+#include <math.h>
+
+struct LoopJitter
+{
+    uint32_t samples = 0;
+    uint64_t totalUs = 0;
+    uint64_t totalSquaresUs = 0;
+    uint32_t maxUs = 0;
+
+    void add(uint32_t periodUs)
+    {
+        samples++;
+        totalUs += periodUs;
+        totalSquaresUs += (uint64_t)periodUs * periodUs;
+        maxUs = max(maxUs, periodUs);
+    }
+
+    uint32_t meanUs() const
+    {
+        return samples ? totalUs / samples : 0;
+    }
+
+    // Standard deviation of the loop period
+    uint32_t stdDevUs() const
+    {
+        if (samples == 0)
+        {
+            return 0;
+        }
+        const double mean = (double)totalUs / samples;
+        const double variance = (double)totalSquaresUs / samples - mean * mean;
+        return variance > 0 ? sqrt(variance) : 0;
+    }
+
+    // {"samples":..,"meanUs":..,"stdDevUs":..,"maxUs":..}
+    void print(Print &out) const
+    {
+        out.print("{\"samples\":");
+        out.print(samples);
+        out.print(",\"meanUs\":");
+        out.print(meanUs());
+        out.print(",\"stdDevUs\":");
+        out.print(stdDevUs());
+        out.print(",\"maxUs\":");
+        out.print(maxUs);
+        out.print('}');
+    }
+};
@@ -1,15 +1,19 @@
 /*
  * MIDI Pedal ESP8266
 
- * This program turns the ESP-8266 into a MIDI controller with 6 buttons
+ * This program turns the ESP-8266 into a MIDI controller with 6 buttons (or more through 74HC165 shift registers)
  * that can send MIDI commands to a MIDI device.
- * The MIDI commands can be configured via a web interface.
- * The configuration is stored in the SPIFFS file system.
+ * The MIDI commands can be configured via a web interface, rendered in the browser from a JSON document.
+ * The configuration is stored in a journal on the SPIFFS (or LittleFS) file system.
  * The web interface is served by a web server running on the ESP-8266.
  * The web server is started only if the ESP-8266 is connected to a Wi-Fi network.
  * The Wi-Fi network is configured via the AP_1, PWD_1, AP_2, PWD_2 constants.
  * The ESP-8266 tries to connect to the first network, if it fails it tries to connect to the second one.
+ * The access point and channel of the last connection are cached and tried first, the networks
+ * are only scanned when that fails.
  * If it fails to connect to both networks, the web server is not started.
+ * In performance mode the Wi-Fi radio, the web server and mDNS are turned off, holding
+ * the first and last buttons together turns them back on.
  *
  * Copyright 2024 Alessandro Pasotti
  *
@@ -25,123 +29,503 @@
 #define AP_2 "SSID_2"      // The SSID (name) of the Wi-Fi network you want to connect to
 #define PWD_2 "PASSWORD_2" // The password of the Wi-Fi network
 
+// Static IP configuration, skips DHCP (comma separated like IPAddress arguments)
+//#define STATIC_IP 192, 168, 1, 50
+#define STATIC_GATEWAY 192, 168, 1, 1
+#define STATIC_SUBNET 255, 255, 255, 0
+#define STATIC_DNS 192, 168, 1, 1
+// Reuse the address obtained by DHCP at the previous boot, when it's the same access point.
+// Faster, but only safe if the router keeps reserving the address for the pedal.
+//#define REUSE_IP_LEASE
+// Time given to the direct connection to the last access point before scanning
+#define WIFI_DIRECT_CONNECT_TIMEOUT_MS 3000
+
 //#define DEBUG
 
+// Storage backend, SPIFFS is used if none is defined
+//#define STORAGE_LITTLEFS
+//#define STORAGE_RAM
+// Print a storage latency benchmark at boot (needs DEBUG)
+//#define STORAGE_BENCHMARK
+
+// Sample the heap around HTTP requests and MIDI sends, reported by GET /heap
+//#define HEAP_STATS
+
 #define LONG_PRESS_INTERVAL_MS 300
 
-#include <OneButton.h>
+// Performance mode: Wi-Fi, web server and mDNS off for the lowest loop jitter.
+// Holding the first and last buttons for PERFORMANCE_GESTURE_MS enters and leaves it.
+// It can also be entered after PERFORMANCE_MODE_IDLE_MS without HTTP requests (0 never):
+// the web interface then goes away without warning until the gesture brings it back
+#define PERFORMANCE_GESTURE_MS 3000
+#define PERFORMANCE_MODE_IDLE_MS 0
+
+// MIDI outputs, commands without a @<ports> suffix go to MIDI_DEFAULT_PORTS
+// (MIDI_PORT_SERIAL1, MIDI_PORT_UART0, MIDI_PORT_NETWORK)
+#define MIDI_DEFAULT_PORTS MIDI_PORT_SERIAL1
+// Second DIN port on UART0 TX, only without DEBUG
+//#define MIDI_UART0_PORT
+// Raw MIDI bytes in UDP datagrams to this host
+//#define MIDI_NETWORK_HOST "192.168.1.10"
+#define MIDI_NETWORK_UDP_PORT 21928
+
+// Expression pedal on A0, see expression_pedal.h for the filter and rate settings
+//#define EXPRESSION_PEDAL
+#define EXPRESSION_CHANNEL 1
+#define EXPRESSION_CC 11
+// Send EXPRESSION_CC (0-31) and EXPRESSION_CC + 32 as a 14-bit pair
+//#define EXPRESSION_14BIT
+
+// Binary configuration and monitoring protocol on the USB serial port (see serial_protocol.h
+// and tools/pedal_serial.py), needs DEBUG and MIDI_UART0_PORT off
+//#define SERIAL_CONFIG_PROTOCOL
+
+// Light sleep between footswitch events in performance mode, for battery powered pedals
+// (see light_sleep.h), without the expression pedal and the serial protocol
+//#define LIGHT_SLEEP
+// Wake pin pulled LOW by any footswitch (GPIO3 is RX, unused by the pedal),
+// without it the footswitches are polled every LIGHT_SLEEP_SLICE_MS
+//#define LIGHT_SLEEP_WAKE_PIN 3
+#define LIGHT_SLEEP_MAX_WAKE_LATENCY_MS 30
+
+// Number of footswitches, more than 6 need the 74HC165 shift register input
+#define BUTTON_COUNT 6
+//#define SHIFT_REGISTER_INPUT
+
 #include "midi_controller.h"
+#include "button_input.h"
+#include "config_journal.h"
+#include "config_document.h"
+#include "loop_jitter.h"
+#include "wifi_cache.h"
+#ifdef EXPRESSION_PEDAL
+#include "expression_pedal.h"
+#endif
+#ifdef HEAP_STATS
+#include "heap_stats.h"
+#endif
+#ifdef SERIAL_CONFIG_PROTOCOL
+#include "serial_protocol.h"
+#endif
+#ifdef LIGHT_SLEEP
+#include "light_sleep.h"
+#endif
 
 #include <ESP8266WiFi.h>
 #include <WiFiClient.h>
 #include <ESP8266WiFiMulti.h>
 #include <ESP8266mDNS.h>
-#include <ESP8266WebServer.h> // Include the WebServer library
-#include <FS.h>               // Include the SPIFFS library
+#include <ESPAsyncTCP.h>
+#include <ESPAsyncWebServer.h> // Event driven web server, requests are parsed and answered between loop() passes
+
+// Web server limits, so a slow or greedy client can't stall the pedal or exhaust the heap
+#define MAX_HTTP_CONNECTIONS 3
+#define MAX_HTTP_REQUEST_SIZE 4096
 
 ESP8266WiFiMulti wifiMulti; // Create an instance of the ESP8266WiFiMulti class, called 'wifiMulti'
 
-ESP8266WebServer server(80); // Create a webserver object that listens for HTTP request on port 80
+// Known networks, in the order they are tried
+const char *const WIFI_SSIDS[] = {AP_1, AP_2};
+const char *const WIFI_PASSWORDS[] = {PWD_1, PWD_2};
+
+// Timing of the last connection: direct connection to the cached access point, scan
+// fallback (0 when not needed) and time since boot when the server was ready
+struct WiFiTiming
+{
+    bool direct = false;
+    unsigned long directMs = 0;
+    unsigned long scanMs = 0;
+    unsigned long readyMs = 0;
+};
+
+WiFiTiming wifiTiming;
+
+AsyncWebServer server(80); // Create a webserver object that listens for HTTP request on port 80
+
+// Requests being served
+uint8_t httpConnections = 0;
+// Start of the last request, for the performance mode idle timeout
+unsigned long lastHttpRequestMs = 0;
+
+bool performanceMode = false;
+
+// Loop period statistics, [0] normal mode, [1] performance mode
+LoopJitter loopJitter[2];
+// Start of the last loop pass, 0 to skip the next sample
+unsigned long lastLoopUs = 0;
+
+// First handler of the chain: counts the requests in progress and answers
+// the ones over the limits before any other handler gets them
+class ConnectionLimitHandler : public AsyncWebHandler
+{
+public:
+    bool canHandle(AsyncWebServerRequest *request) override
+    {
+        if (httpConnections >= MAX_HTTP_CONNECTIONS || request->contentLength() > MAX_HTTP_REQUEST_SIZE)
+        {
+            return true;
+        }
+        httpConnections++;
+        lastHttpRequestMs = millis();
+#ifdef HEAP_STATS
+        sampleHeap(HEAP_HTTP);
+#endif
+        request->onDisconnect([]() {
+            httpConnections--;
+#ifdef HEAP_STATS
+            sampleHeap(HEAP_HTTP);
+#endif
+        });
+        return false;
+    }
 
-String getContentType(String filename); // convert the file extension to the MIME type
-bool handleFileRead(String path);       // send the right file to the client (if it exists)
+    void handleRequest(AsyncWebServerRequest *request) override
+    {
+        if (request->contentLength() > MAX_HTTP_REQUEST_SIZE)
+        {
+            request->send(413, "text/plain", "413: Payload Too Large");
+        }
+        else
+        {
+            request->send(503, "text/plain", "503: Service Unavailable");
+        }
+    }
+};
 
 // MIDI Buttons configuration
 
-OneButton btn1 = OneButton(
-    BUTTON_PIN1, // Input pin for the button
-    true,        // Button is active LOW
-    true         // Enable internal pull-up resistor
-);
-
-OneButton btn2 = OneButton(
-    BUTTON_PIN2, // Input pin for the button
-    true,        // Button is active LOW
-    true         // Enable internal pull-up resistor
-);
-
-OneButton btn3 = OneButton(
-    BUTTON_PIN3, // Input pin for the button
-    true,        // Button is active LOW
-    true         // Enable internal pull-up resistor
-);
-
-OneButton btn4 = OneButton(
-    BUTTON_PIN4, // Input pin for the button
-    true,        // Button is active LOW
-    true         // Enable internal pull-up resistor
-);
-
-OneButton btn5 = OneButton(
-    BUTTON_PIN5, // Input pin for the button
-    true,        // Button is active LOW
-    true         // Enable internal pull-up resistor
-);
-
-OneButton btn6 = OneButton(
-    BUTTON_PIN6, // Input pin for the button
-    true,        // Button is active LOW
-    true         // Enable internal pull-up resistor
-);
-
-// Array of 6 midi buttons
-MIDIButtonCommands midiButtons[6];
-MIDICommandFlags midiCommandFlags[6];
+#ifdef SHIFT_REGISTER_INPUT
+ButtonScanner<BUTTON_COUNT, ShiftRegisterButtonInput> footswitches(SHIFT_REGISTER_LOAD_PIN);
+#else
+static_assert(BUTTON_COUNT == 6, "Direct GPIO input supports 6 buttons, use SHIFT_REGISTER_INPUT for more");
+const uint8_t buttonPins[BUTTON_COUNT] = {BUTTON_PIN1, BUTTON_PIN2, BUTTON_PIN3, BUTTON_PIN4, BUTTON_PIN5, BUTTON_PIN6};
+ButtonScanner<BUTTON_COUNT, GPIOButtonInput> footswitches(buttonPins);
+#endif
+
+// Array of midi buttons
+MIDIButtonCommands midiButtons[BUTTON_COUNT];
+
+#ifdef EXPRESSION_PEDAL
+ExpressionPedal expressionPedal;
+#endif
+
+// Persistent storage of the buttons configuration
+ConfigJournal<BUTTON_COUNT> configJournal(midiButtons, storage);
+
+// Memory budget of the largest globals, a fixed share of the ~80 KB of DRAM: growing them,
+// including with more buttons, must be a deliberate change
+#define STATIC_RAM_BUDGET 9216
+static_assert(sizeof(midiButtons) + sizeof(footswitches) + sizeof(configJournal) + sizeof(sysexStream) + sizeof(midiPorts) <= STATIC_RAM_BUDGET,
+              "Static RAM is over its budget");
+
+#ifdef LIGHT_SLEEP
+LightSleep lightSleep;
+#endif
+
+#ifdef SERIAL_CONFIG_PROTOCOL
+SerialProtocol serialProtocol(Serial);
+// MIDI and VAR events are sent to the host
+bool serialMonitor = false;
+#endif
+
+// Set by the web and serial handlers, the configuration is saved from loop()
+bool configChanged = false;
+
+// Hash of the configuration document, computed when needed
+uint32_t configHash = 0;
+bool configHashValid = false;
+
+String configHashString()
+{
+    if (!configHashValid)
+    {
+        configHash = configDocumentHash<BUTTON_COUNT>(midiButtons);
+        configHashValid = true;
+    }
+    char hash[9];
+    snprintf(hash, sizeof(hash), "%08x", configHash);
+    return hash;
+}
 
 // Button
 
+void onMIDIButtonVarChanged(MIDIButtonCommands &button)
+{
+    configJournal.saveVar(&button - midiButtons);
+
+#ifdef SERIAL_CONFIG_PROTOCOL
+    if (serialMonitor)
+    {
+        const int32_t value = button.var.value;
+        const uint8_t event[5] = {(uint8_t)(&button - midiButtons + 1), (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16),
+                                  (uint8_t)(value >> 24)};
+        serialProtocol.sendFrame(SERIAL_VAR_EVENT, event, sizeof(event));
+    }
+#endif
+}
+
 void initMIDIButtons()
 {
-    initMIDIButton(midiButtons[0], "/button1");
-    initMIDIButton(midiButtons[1], "/button2");
-    initMIDIButton(midiButtons[2], "/button3");
-    initMIDIButton(midiButtons[3], "/button4");
-    initMIDIButton(midiButtons[4], "/button5");
-    initMIDIButton(midiButtons[5], "/button6");
-
-    btn1.setIdleMs(midiButtons[0].doublePush.count == 0 ? 60 : 1000);
-    btn2.setIdleMs(midiButtons[1].doublePush.count == 0 ? 60 : 1000);
-    btn3.setIdleMs(midiButtons[2].doublePush.count == 0 ? 60 : 1000);
-    btn4.setIdleMs(midiButtons[3].doublePush.count == 0 ? 60 : 1000);
-    btn5.setIdleMs(midiButtons[4].doublePush.count == 0 ? 60 : 1000);
-    btn6.setIdleMs(midiButtons[5].doublePush.count == 0 ? 60 : 1000);
-
-    btn1.setClickMs(midiButtons[0].doublePush.count == 0 ? 60 : 400);
-    btn2.setClickMs(midiButtons[1].doublePush.count == 0 ? 60 : 400);
-    btn3.setClickMs(midiButtons[2].doublePush.count == 0 ? 60 : 400);
-    btn4.setClickMs(midiButtons[3].doublePush.count == 0 ? 60 : 400);
-    btn5.setClickMs(midiButtons[4].doublePush.count == 0 ? 60 : 400);
-    btn6.setClickMs(midiButtons[5].doublePush.count == 0 ? 60 : 400);
+    if (!configJournal.load())
+    {
+        // Import the configuration saved before the journal existed
+        for (uint8_t i = 0; i < BUTTON_COUNT; i++)
+        {
+            initMIDIButton(midiButtons[i], "/button" + String(i + 1));
+        }
+        configJournal.compact();
+    }
+}
+
+// Double push detection delays the push, so it's only enabled when there are double push commands
+void applyButtonTimings()
+{
+    for (uint8_t i = 0; i < BUTTON_COUNT; i++)
+    {
+        footswitches[i].setIdleMs(midiButtons[i].doublePush.count == 0 ? 60 : 1000);
+        footswitches[i].setClickMs(midiButtons[i].doublePush.count == 0 ? 60 : 400);
+        footswitches[i].setLongPressIntervalMs(LONG_PRESS_INTERVAL_MS);
 
 #ifdef DEBUG
+        Serial.println("Button " + String(i + 1) + " doublepush count: " + String(midiButtons[i].doublePush.count));
+#endif
+    }
+}
 
-    // Print doublepush count for all buttons
-    Serial.println("Doublepush count");
-    Serial.println("Button 1: " + String(midiButtons[0].doublePush.count));
-    Serial.println("Button 2: " + String(midiButtons[1].doublePush.count));
-    Serial.println("Button 3: " + String(midiButtons[2].doublePush.count));
-    Serial.println("Button 4: " + String(midiButtons[3].doublePush.count));
-    Serial.println("Button 5: " + String(midiButtons[4].doublePush.count));
-    Serial.println("Button 6: " + String(midiButtons[5].doublePush.count));
+void redirectToIndex(AsyncWebServerRequest *request)
+{
+    AsyncWebServerResponse *response = request->beginResponse(303, "text/plain", "See Other"); // browser will immediately ask for the page at the new location
+    response->addHeader("Location", "/index.html");                                              // redirect to our html web page
+    request->send(response);
+}
 
-#endif
+// If-Match of a conditional PUT /config: "*" or one of the comma separated entity tags is the
+// configuration hash, as the ETag of GET /config (weak) or the config TXT record of mDNS (plain)
+bool configHashMatches(const String &ifMatch)
+{
+    const String hash = configHashString();
+    int start = 0;
+    while (start < (int)ifMatch.length())
+    {
+        int end = ifMatch.indexOf(',', start);
+        if (end < 0)
+        {
+            end = ifMatch.length();
+        }
+        String tag = ifMatch.substring(start, end);
+        tag.trim();
+        if (tag.startsWith("W/"))
+        {
+            tag = tag.substring(2);
+        }
+        tag.replace("\"", "");
+        if (tag == "*" || tag == hash)
+        {
+            return true;
+        }
+        start = end + 1;
+    }
+    return false;
+}
+
+// Replace the whole configuration from a JSON document, for PUT /config and the serial protocol.
+// Returns the HTTP status: 412 when ifMatch is given and doesn't match the current hash (the
+// configuration changed since the client read it), 400 (with the message) unless all of it
+// is valid, 304 when the hash is the same as the current one and nothing needs saving, 204
+// otherwise. The hash leaves out the VAR values: with the configuration already in place they are kept.
+int putConfigDocument(const char *json, size_t length, String &message, const String &ifMatch = String())
+{
+    if (ifMatch.length() > 0 && !configHashMatches(ifMatch))
+    {
+        message = "412: Precondition Failed";
+        return 412;
+    }
+
+    JsonDocument document;
+    const DeserializationError error = json ? deserializeJson(document, json, length) : DeserializationError::EmptyInput;
+    if (error)
+    {
+        message = String("400: ") + error.c_str();
+        return 400;
+    }
 
-    btn1.setLongPressIntervalMs(LONG_PRESS_INTERVAL_MS);
-    btn2.setLongPressIntervalMs(LONG_PRESS_INTERVAL_MS);
-    btn3.setLongPressIntervalMs(LONG_PRESS_INTERVAL_MS);
-    btn4.setLongPressIntervalMs(LONG_PRESS_INTERVAL_MS);
-    btn5.setLongPressIntervalMs(LONG_PRESS_INTERVAL_MS);
-    btn6.setLongPressIntervalMs(LONG_PRESS_INTERVAL_MS);
+    message = applyConfigDocument<BUTTON_COUNT>(document, midiButtons, true);
+    if (message.length() > 0)
+    {
+        message = "400: " + message;
+        return 400;
+    }
+
+    const String previousHash = configHashString();
+    int values[BUTTON_COUNT];
+    for (uint8_t i = 0; i < BUTTON_COUNT; i++)
+    {
+        values[i] = midiButtons[i].var.value;
+    }
+    applyConfigDocument<BUTTON_COUNT>(document, midiButtons, false);
+    configHashValid = false;
+    if (configHashString() == previousHash)
+    {
+        for (uint8_t i = 0; i < BUTTON_COUNT; i++)
+        {
+            midiButtons[i].var.value = values[i];
+        }
+        return 304;
+    }
+
+    // Saved from loop() in a single journal transaction
+    configChanged = true;
+    return 204;
 }
 
-bool serverStart()
+// Known Wi-Fi networks, set once at boot before the first connection: without a
+// cached access point (e.g. on a fresh device) the connection scans for them
+void wifiSetup()
 {
     // add Wi-Fi networks you want to connect to
-    wifiMulti.addAP(AP_1, PWD_1);
-    wifiMulti.addAP(AP_2, PWD_1);
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        wifiMulti.addAP(WIFI_SSIDS[i], WIFI_PASSWORDS[i]);
+    }
 
-#ifdef DEBUG
-    Serial.println("Connecting ...");
+    // The connection is cached in storage, the SDK doesn't need to write it to flash too
+    WiFi.persistent(false);
+    WiFi.mode(WIFI_STA);
+}
+
+// Web server routes, set once at boot: the server can be stopped and started
+// again (see the performance mode)
+void serverSetup()
+{
+    server.addHandler(new ConnectionLimitHandler());
+
+    // Redirect / to index.html
+    server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
+        redirectToIndex(request);
+    });
+
+    // Whole configuration as a JSON document
+    server.on("/config", HTTP_GET, [](AsyncWebServerRequest *request) {
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        // Weak: the body also carries the VAR values, which the hash leaves out
+        response->addHeader("ETag", "W/\"" + configHashString() + "\"");
+        printConfigDocument<BUTTON_COUNT>(*response, midiButtons);
+        request->send(response);
+    });
+
+    // Replace the whole configuration, nothing is changed unless all of it is valid.
+    // A configuration with the same hash as the current one is not saved again (304).
+    // With If-Match, only while the configuration still has that hash (412 otherwise)
+    server.on(
+        "/config", HTTP_PUT,
+        [](AsyncWebServerRequest *request) {
+            String message;
+            const AsyncWebHeader *ifMatch = request->getHeader("If-Match");
+            const int status = putConfigDocument((const char *)request->_tempObject, request->contentLength(), message,
+                                                 ifMatch ? ifMatch->value() : String());
+            if (status == 400 || status == 412)
+            {
+                request->send(status, "text/plain", message);
+                return;
+            }
+            request->send(status);
+        },
+        nullptr,
+        [](AsyncWebServerRequest *request, uint8_t *data, size_t length, size_t index, size_t total) {
+            // Collect the body, its size is capped by ConnectionLimitHandler and the buffer freed with the request
+            if (index == 0)
+            {
+                request->_tempObject = malloc(total);
+            }
+            if (request->_tempObject)
+            {
+                memcpy((uint8_t *)request->_tempObject + index, data, length);
+            }
+        });
+
+#ifdef HEAP_STATS
+    server.on("/heap", HTTP_GET, [](AsyncWebServerRequest *request) {
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        printHeapStats(*response);
+        request->send(response);
+    });
+#endif
+
+    // Bytes, drops and latency of each MIDI output port
+    server.on("/ports", HTTP_GET, [](AsyncWebServerRequest *request) {
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        printMIDIPortStats(*response);
+        request->send(response);
+    });
+
+    // Connection timing, to check how long after power on the pedal is reachable
+    server.on("/wifi", HTTP_GET, [](AsyncWebServerRequest *request) {
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        response->print("{\"ssid\":\"" + WiFi.SSID() + "\",\"bssid\":\"" + WiFi.BSSIDstr() + "\",\"channel\":" + String(WiFi.channel()) +
+                        ",\"direct\":" + (wifiTiming.direct ? "true" : "false") + ",\"directMs\":" + String(wifiTiming.directMs) +
+                        ",\"scanMs\":" + String(wifiTiming.scanMs) + ",\"readyMs\":" + String(wifiTiming.readyMs) + "}");
+        request->send(response);
+    });
+
+    // Loop jitter of both modes: {"normal":{..},"performance":{..}}
+    server.on("/jitter", HTTP_GET, [](AsyncWebServerRequest *request) {
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        response->print("{\"normal\":");
+        loopJitter[0].print(*response);
+        response->print(",\"performance\":");
+        loopJitter[1].print(*response);
+        response->print('}');
+        request->send(response);
+    });
+
+#ifdef LIGHT_SLEEP
+    // Light sleep slices and wake latencies, reported when leaving the performance mode
+    server.on("/sleep", HTTP_GET, [](AsyncWebServerRequest *request) {
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        lightSleep.print(*response);
+        request->send(response);
+    });
+#endif
+
+    // The web interface is sent from storage, gzipped (see tools/build_web.py): the
+    // page renders the buttons from GET /config and saves them with PUT /config. Only
+    // WEB_ROOT is served, the journal, Wi-Fi cache and SysEx files stay private
+    server.serveStatic("/", storage, WEB_ROOT "/");
+
+    server.onNotFound([](AsyncWebServerRequest *request) {
+        request->send(404, "text/plain", "404: Not Found"); // respond with a 404 (Not Found) error
+    });
+}
+
+// Connect to the access point of the last connection on its channel, without scanning
+bool wifiConnectDirect(const WiFiCache &cache)
+{
+#if defined(STATIC_IP)
+    WiFi.config(IPAddress(STATIC_IP), IPAddress(STATIC_GATEWAY), IPAddress(STATIC_SUBNET), IPAddress(STATIC_DNS));
+#elif defined(REUSE_IP_LEASE)
+    if (cache.ip != 0)
+    {
+        WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet), IPAddress(cache.dns));
+    }
+#endif
+    WiFi.begin(WIFI_SSIDS[cache.network], WIFI_PASSWORDS[cache.network], cache.channel, cache.bssid);
+
+    const unsigned long start = millis();
+    while (WiFi.status() != WL_CONNECTED && millis() - start < WIFI_DIRECT_CONNECT_TIMEOUT_MS)
+    {
+        delay(10);
+    }
+    return WiFi.status() == WL_CONNECTED;
+}
+
+// Scan for the known networks and connect to the strongest one
+bool wifiConnectScan()
+{
+#ifdef STATIC_IP
+    WiFi.config(IPAddress(STATIC_IP), IPAddress(STATIC_GATEWAY), IPAddress(STATIC_SUBNET), IPAddress(STATIC_DNS));
+#else
+    // Back to DHCP, a reused lease may belong to another network
+    WiFi.config(IPAddress(), IPAddress(), IPAddress());
 #endif
 
     int i = 0;
@@ -153,13 +537,55 @@ bool serverStart()
 #ifdef DEBUG
         Serial.print('.');
 #endif
-        ++i;
     }
+    return WiFi.status() == WL_CONNECTED;
+}
 
-    const wl_status_t status = WiFi.status();
+// Remember the access point and the lease of the current connection
+void wifiSaveConnection()
+{
+    WiFiCache cache;
+    cache.network = WiFi.SSID() == WIFI_SSIDS[1] ? 1 : 0;
+    memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+    cache.channel = WiFi.channel();
+    cache.ip = WiFi.localIP();
+    cache.gateway = WiFi.gatewayIP();
+    cache.subnet = WiFi.subnetMask();
+    cache.dns = WiFi.dnsIP();
+    saveWiFiCache(storage, cache);
+}
+
+bool serverStart()
+{
+#ifdef DEBUG
+    Serial.println("Connecting ...");
+#endif
+
+    wifiTiming = WiFiTiming();
+    unsigned long start = millis();
+
+    WiFiCache cache;
+    bool connected = false;
+    if (loadWiFiCache(storage, cache))
+    {
+        connected = wifiConnectDirect(cache);
+        wifiTiming.direct = connected;
+        wifiTiming.directMs = millis() - start;
+    }
+
+    if (!connected)
+    {
+        // The access point moved or is gone: full scan
+        WiFi.disconnect();
+        start = millis();
+        connected = wifiConnectScan();
+        wifiTiming.scanMs = millis() - start;
+    }
 
-    if (status == WL_CONNECTED)
+    if (connected)
     {
+        wifiSaveConnection();
+
 #ifdef DEBUG
         Serial.println('\n');
         Serial.print("Connected to ");
@@ -167,10 +593,17 @@ bool serverStart()
         Serial.print("IP address:\t");
         Serial.println(WiFi.localIP()); // Send the IP address of the ESP8266 to the computer
 #endif
-        if (MDNS.begin("esp8266"))
-        { // Start the mDNS responder for esp8266.local
+        // Unique name per pedal, e.g. midi-pedal-1a2b3c.local
+        const String hostname = "midi-pedal-" + String(ESP.getChipId(), HEX);
+        if (MDNS.begin(hostname))
+        { // Start the mDNS responder for <hostname>.local
+            // The TXT record carries the configuration hash, so a fleet can be checked with discovery queries only
+            MDNS.addService(nullptr, "http", "tcp", 80);
+            MDNS.setDynamicServiceTxtCallback([](const MDNSResponder::hMDNSService service) {
+                MDNS.addDynamicServiceTxt(service, "config", configHashString().c_str());
+            });
 #ifdef DEBUG
-            Serial.println("mDNS responder started");
+            Serial.println("mDNS responder started as " + hostname + ".local");
         }
         else
         {
@@ -178,121 +611,13 @@ bool serverStart()
 #endif
         }
 
-        // Redirect / to index.html
-        server.on("/", HTTP_GET, []() {
-            server.sendHeader("Location", "/index.html", true); // redirect to our html web page
-            server.send(303, "text/plain", "See Other");        // return a 302 redirect (browser will immediately ask for the page at the new location)
-        });
-
-        server.on("/set", HTTP_POST, []() { // If the client requests the root path, send them to the control page
-                                            // Parse command
-
-#ifdef DEBUG
-            Serial.println("POST /set");
-#endif
-            for (int i = 0; i < 6; i++)
-            {
-#ifdef DEBUG
-                Serial.println("Button " + String(i + 1));
-                Serial.println("PUSH " + server.arg("BUTTON_" + String(i + 1) + "_PUSH"));
-                Serial.println("HOLD " + server.arg("BUTTON_" + String(i + 1) + "_HOLD"));
-                Serial.println("DOUBLE_PUSH" + server.arg("BUTTON_" + String(i + 1) + "_DOUBLE_PUSH"));
-#endif
-                midiButtons[i].push = parseMIDICommands(server.arg("BUTTON_" + String(i + 1) + "_PUSH"));
-                midiButtons[i].hold = parseMIDICommands(server.arg("BUTTON_" + String(i + 1) + "_HOLD"));
-                midiButtons[i].doublePush = parseMIDICommands(server.arg("BUTTON_" + String(i + 1) + "_DOUBLE_PUSH"));
-                midiButtons[i].flags.repeatOnHold = server.arg("BUTTON_" + String(i + 1) + "_REPEAT_FLAG") == "1";
-                //midiButtons[i].flags.disableDoublePush = server.arg("BUTTON_" + String(i + 1) + "_DISABLE_DOUBLE_FLAG") == "1";
-                midiButtons[i].var.min = server.arg("BUTTON_" + String(i + 1) + "_VAR_MIN").toInt();
-                midiButtons[i].var.max = server.arg("BUTTON_" + String(i + 1) + "_VAR_MAX").toInt();
-                midiButtons[i].var.value = server.arg("BUTTON_" + String(i + 1) + "_VAR_VALUE").toInt();
-
-                // Write values to SPIFFS
-                saveMIDIButton(midiButtons[i], "/button" + String(i + 1));
-            }
-
-            server.sendHeader("Location", "/index.html", true); // redirect to our html web page
-            server.send(303, "text/plain", "See Other");        // return a 302 redirect (browser will immediately ask for the page at the new location)
-        });
-
-        server.on("/index.html", HTTP_GET, []() {
-            File file = SPIFFS.open("/index.html", "r");
-
-            // read file content into String
-            String form = file.readString();
-            file.close();
-
-            // Replace all 6 button form placeholder with actual values
-            form.replace("{{BUTTON_1_PUSH}}", midiButtons[0].push.toString());
-            form.replace("{{BUTTON_1_HOLD}}", midiButtons[0].hold.toString());
-            form.replace("{{BUTTON_1_DOUBLE_PUSH}}", midiButtons[0].doublePush.toString());
-            form.replace("{{BUTTON_1_REPEAT_FLAG}}", midiButtons[0].flags.repeatOnHold ? "checked" : "");
-            //form.replace("{{BUTTON_1_DISABLE_DOUBLE_FLAG}}", midiButtons[0].flags.disableDoublePush ? "checked" : "");
-            form.replace("{{BUTTON_1_VAR_MIN}}", String(midiButtons[0].var.min));
-            form.replace("{{BUTTON_1_VAR_MAX}}", String(midiButtons[0].var.max));
-            form.replace("{{BUTTON_1_VAR_VALUE}}", String(midiButtons[0].var.value));
-
-            form.replace("{{BUTTON_2_PUSH}}", midiButtons[1].push.toString());
-            form.replace("{{BUTTON_2_HOLD}}", midiButtons[1].hold.toString());
-            form.replace("{{BUTTON_2_DOUBLE_PUSH}}", midiButtons[1].doublePush.toString());
-            form.replace("{{BUTTON_2_REPEAT_FLAG}}", midiButtons[1].flags.repeatOnHold ? "checked" : "");
-            //form.replace("{{BUTTON_2_DISABLE_DOUBLE_FLAG}}", midiButtons[1].flags.disableDoublePush ? "checked" : "");
-            form.replace("{{BUTTON_2_VAR_MIN}}", String(midiButtons[1].var.min));
-            form.replace("{{BUTTON_2_VAR_MAX}}", String(midiButtons[1].var.max));
-            form.replace("{{BUTTON_2_VAR_VALUE}}", String(midiButtons[1].var.value));
-
-            form.replace("{{BUTTON_3_PUSH}}", midiButtons[2].push.toString());
-            form.replace("{{BUTTON_3_HOLD}}", midiButtons[2].hold.toString());
-            form.replace("{{BUTTON_3_DOUBLE_PUSH}}", midiButtons[2].doublePush.toString());
-            form.replace("{{BUTTON_3_REPEAT_FLAG}}", midiButtons[2].flags.repeatOnHold ? "checked" : "");
-            //form.replace("{{BUTTON_3_DISABLE_DOUBLE_FLAG}}", midiButtons[2].flags.disableDoublePush ? "checked" : "");
-            form.replace("{{BUTTON_3_VAR_MIN}}", String(midiButtons[2].var.min));
-            form.replace("{{BUTTON_3_VAR_MAX}}", String(midiButtons[2].var.max));
-            form.replace("{{BUTTON_3_VAR_VALUE}}", String(midiButtons[2].var.value));
-
-            form.replace("{{BUTTON_4_PUSH}}", midiButtons[3].push.toString());
-            form.replace("{{BUTTON_4_HOLD}}", midiButtons[3].hold.toString());
-            form.replace("{{BUTTON_4_DOUBLE_PUSH}}", midiButtons[3].doublePush.toString());
-            form.replace("{{BUTTON_4_REPEAT_FLAG}}", midiButtons[3].flags.repeatOnHold ? "checked" : "");
-            //form.replace("{{BUTTON_4_DISABLE_DOUBLE_FLAG}}", midiButtons[3].flags.disableDoublePush ? "checked" : "");
-            form.replace("{{BUTTON_4_VAR_MIN}}", String(midiButtons[3].var.min));
-            form.replace("{{BUTTON_4_VAR_MAX}}", String(midiButtons[3].var.max));
-            form.replace("{{BUTTON_4_VAR_VALUE}}", String(midiButtons[3].var.value));
-
-            form.replace("{{BUTTON_5_PUSH}}", midiButtons[4].push.toString());
-            form.replace("{{BUTTON_5_HOLD}}", midiButtons[4].hold.toString());
-            form.replace("{{BUTTON_5_DOUBLE_PUSH}}", midiButtons[4].doublePush.toString());
-            form.replace("{{BUTTON_5_REPEAT_FLAG}}", midiButtons[4].flags.repeatOnHold ? "checked" : "");
-            //form.replace("{{BUTTON_5_DISABLE_DOUBLE_FLAG}}", midiButtons[4].flags.disableDoublePush ? "checked" : "");
-            form.replace("{{BUTTON_5_VAR_MIN}}", String(midiButtons[4].var.min));
-            form.replace("{{BUTTON_5_VAR_MAX}}", String(midiButtons[4].var.max));
-            form.replace("{{BUTTON_5_VAR_VALUE}}", String(midiButtons[4].var.value));
-
-            form.replace("{{BUTTON_6_PUSH}}", midiButtons[5].push.toString());
-            form.replace("{{BUTTON_6_HOLD}}", midiButtons[5].hold.toString());
-            form.replace("{{BUTTON_6_DOUBLE_PUSH}}", midiButtons[5].doublePush.toString());
-            form.replace("{{BUTTON_6_REPEAT_FLAG}}", midiButtons[5].flags.repeatOnHold ? "checked" : "");
-            //form.replace("{{BUTTON_6_DISABLE_DOUBLE_FLAG}}", midiButtons[5].flags.disableDoublePush ? "checked" : "");
-            form.replace("{{BUTTON_6_VAR_MIN}}", String(midiButtons[5].var.min));
-            form.replace("{{BUTTON_6_VAR_MAX}}", String(midiButtons[5].var.max));
-            form.replace("{{BUTTON_6_VAR_VALUE}}", String(midiButtons[5].var.value));
-
-#ifdef DEBUG
-            Serial.println("Sending form");
-#endif
-            server.send(200, "text/html", form); //Send web page
-        });
-
-        server.onNotFound([]() {                                  // If the client requests any URI
-            if (!handleFileRead(server.uri()))                    // send it if it exists
-                server.send(404, "text/plain", "404: Not Found"); // otherwise, respond with a 404 (Not Found) error
-        });
-
         server.begin(); // Actually start the server
+        wifiTiming.readyMs = millis();
 #ifdef DEBUG
         Serial.println("HTTP server started");
+        Serial.println("Wi-Fi " + String(wifiTiming.direct ? "direct" : "scan") + " connection, direct " + String(wifiTiming.directMs) +
+                       " ms, scan " + String(wifiTiming.scanMs) + " ms, ready " + String(wifiTiming.readyMs) + " ms after boot");
 #endif
-        SPIFFS.begin(); // Start the SPI Flash Files System
 
         return true;
     }
@@ -311,50 +636,214 @@ bool serverStart()
 bool isLedOn = false;
 int clickNumber = 0;
 
+// Set from the scan where the first and last buttons are both down until both are idle again:
+// the performance mode gesture doesn't send the commands of the two buttons
+bool gestureChord = false;
+
+bool isGestureButton(int btn)
+{
+    return gestureChord && (btn == 1 || btn == BUTTON_COUNT);
+}
+
+void sendButtonCommands(const MIDICommandList &commandList, MIDIButtonCommands &button)
+{
+#ifdef HEAP_STATS
+    sampleHeap(HEAP_MIDI_SEND);
+#endif
+    sendMIDICommandList(commandList, button);
+#ifdef HEAP_STATS
+    sampleHeap(HEAP_MIDI_SEND);
+#endif
+}
+
 void push(int btn)
 {
+    if (isGestureButton(btn))
+    {
+        return;
+    }
 #ifdef DEBUG
     Serial.println("Button " + String(btn) + " push");
 #endif
     // btn is 1-based, so we need to subtract 1 to get the correct CC number
-    sendMIDICommandList(midiButtons[btn - 1].push, midiButtons[btn - 1]);
+    sendButtonCommands(midiButtons[btn - 1].push, midiButtons[btn - 1]);
 }
 
 void hold(int btn)
 {
-    if (midiButtons[btn - 1].flags.repeatOnHold)
+    if (midiButtons[btn - 1].flags.repeatOnHold && !isGestureButton(btn))
     {
 #ifdef DEBUG
         Serial.println("Button " + String(btn) + " hold");
 #endif
         // btn is 1-based, so we need to subtract 1 to get the correct CC number
-        sendMIDICommandList(midiButtons[btn - 1].hold, midiButtons[btn - 1]);
+        sendButtonCommands(midiButtons[btn - 1].hold, midiButtons[btn - 1]);
     }
 }
 
 void longPressStart(int btn)
 {
-    if (!midiButtons[btn - 1].flags.repeatOnHold)
+    if (!midiButtons[btn - 1].flags.repeatOnHold && !isGestureButton(btn))
     {
 #ifdef DEBUG
         Serial.println("Button " + String(btn) + " long press start");
 #endif
         // btn is 1-based, so we need to subtract 1 to get the correct CC number
-        sendMIDICommandList(midiButtons[btn - 1].hold, midiButtons[btn - 1]);
+        sendButtonCommands(midiButtons[btn - 1].hold, midiButtons[btn - 1]);
     }
 }
 
 void doublepush(int btn)
 {
+    if (isGestureButton(btn))
+    {
+        return;
+    }
 #ifdef DEBUG
     Serial.println("Button " + String(btn) + " double push");
 #endif
     // btn is 1-based, so we need to subtract 1 to get the correct CC number
-    sendMIDICommandList(midiButtons[btn - 1].doublePush, midiButtons[btn - 1]);
+    sendButtonCommands(midiButtons[btn - 1].doublePush, midiButtons[btn - 1]);
 }
 
+#ifdef SERIAL_CONFIG_PROTOCOL
+void onMIDIMessage(const uint8_t *message, uint8_t length, uint8_t ports)
+{
+    if (serialMonitor)
+    {
+        serialProtocol.sendFrame(SERIAL_MIDI_EVENT, [message, length, ports](Print &out) {
+            out.write(ports);
+            out.write(message, length);
+        });
+    }
+}
+
+void onSerialFrame(uint8_t opcode, const uint8_t *payload, uint16_t length)
+{
+    const uint8_t reply = opcode | SERIAL_REPLY;
+    switch (opcode)
+    {
+    case SERIAL_PING:
+    {
+        const uint8_t pong[2] = {SERIAL_PROTOCOL_VERSION, BUTTON_COUNT};
+        serialProtocol.sendFrame(reply, pong, sizeof(pong));
+        break;
+    }
+    case SERIAL_GET_CONFIG:
+        serialProtocol.sendFrame(reply, [](Print &out) {
+            printConfigDocument<BUTTON_COUNT>(out, midiButtons);
+        });
+        break;
+    case SERIAL_PUT_CONFIG:
+    {
+        // Same validation and storage path as PUT /config
+        String message;
+        const int status = putConfigDocument((const char *)payload, length, message);
+        serialProtocol.sendFrame(reply, [status, &message](Print &out) {
+            out.write((uint8_t)status);
+            out.write((uint8_t)(status >> 8));
+            out.print(message);
+        });
+        break;
+    }
+    case SERIAL_TRIGGER:
+    {
+        const uint8_t btn = length == 2 ? payload[0] : 0;
+        if (btn < 1 || btn > BUTTON_COUNT || payload[1] > 2)
+        {
+            serialProtocol.sendFrame(SERIAL_ERROR, (const uint8_t *)"Invalid trigger", 15);
+            break;
+        }
+        // Same gestures as the footswitches, a hold sends the hold commands once
+        if (payload[1] == 0)
+        {
+            push(btn);
+        }
+        else if (payload[1] == 1)
+        {
+            longPressStart(btn);
+            hold(btn);
+        }
+        else
+        {
+            doublepush(btn);
+        }
+        serialProtocol.sendFrame(reply, nullptr, 0);
+        break;
+    }
+    case SERIAL_MONITOR:
+        serialMonitor = length == 1 && payload[0] != 0;
+        serialProtocol.sendFrame(reply, nullptr, 0);
+        break;
+    default:
+        serialProtocol.sendFrame(SERIAL_ERROR, (const uint8_t *)"Unknown opcode", 14);
+        break;
+    }
+}
+#endif
+
 bool serverStarted = false;
 
+void enterPerformanceMode()
+{
+#ifdef DEBUG
+    Serial.println("Entering performance mode");
+#endif
+    if (serverStarted)
+    {
+        server.end();
+        MDNS.close();
+        serverStarted = false;
+        // httpConnections drains through the disconnects of the requests still in flight
+    }
+    WiFi.disconnect();
+    WiFi.mode(WIFI_OFF);
+    WiFi.forceSleepBegin();
+    performanceMode = true;
+    lastLoopUs = 0;
+
+    // switch led off
+    digitalWrite(LED_BUILTIN_AUX, HIGH);
+}
+
+// Blocks while connecting, like at boot
+void leavePerformanceMode()
+{
+#ifdef DEBUG
+    Serial.println("Leaving performance mode");
+#endif
+    WiFi.forceSleepWake();
+    WiFi.mode(WIFI_STA);
+    performanceMode = false;
+    serverStarted = serverStart();
+    lastHttpRequestMs = millis();
+    lastLoopUs = 0;
+
+    digitalWrite(LED_BUILTIN_AUX, serverStarted ? LOW : HIGH);
+}
+
+// Default MIDI commands for empty buttons (RC-5), kept in flash and validated at compile time
+static_assert(BUTTON_COUNT >= 6, "The default MIDI commands are defined for 6 buttons");
+constexpr MIDICommand DEFAULT_TRK_PS[] PROGMEM = {{CC, 1, 80, 127}, {CC, 1, 80, 0}};
+constexpr MIDICommand DEFAULT_TRK_CLR[] PROGMEM = {{CC, 1, 81, 127}, {CC, 1, 81, 0}};
+constexpr MIDICommand DEFAULT_UNDO_REDO[] PROGMEM = {{CC, 1, 82, 127}, {CC, 1, 82, 0}};
+constexpr MIDICommand DEFAULT_RYTHM_PS[] PROGMEM = {{CC, 1, 83, 127}, {CC, 1, 83, 0}};
+constexpr MIDICommand DEFAULT_TAP_TEMPO[] PROGMEM = {{CC, 1, 84, 127}, {CC, 1, 84, 0}};
+constexpr MIDICommand DEFAULT_PATTERN_INC[] PROGMEM = {{VAR_INC, 1, 1, 0}, {CC, 1, 85, MIDI_VAR}, {CC, 1, 85, 127}};
+constexpr MIDICommand DEFAULT_PATTERN_DEC[] PROGMEM = {{VAR_DEC, 1, 1, 0}, {CC, 1, 85, MIDI_VAR}, {CC, 1, 85, 127}};
+constexpr MIDICommand DEFAULT_MEM_INC[] PROGMEM = {{CC, 1, 86, 127}, {CC, 1, 86, 0}};
+constexpr MIDICommand DEFAULT_MEM_DEC[] PROGMEM = {{CC, 1, 87, 127}, {CC, 1, 87, 0}};
+
+static_assert(isValidMIDICommands(DEFAULT_TRK_PS), "Invalid default TRK P/S commands");
+static_assert(isValidMIDICommands(DEFAULT_TRK_CLR), "Invalid default TRK CLR commands");
+static_assert(isValidMIDICommands(DEFAULT_UNDO_REDO), "Invalid default UNDO/REDO commands");
+static_assert(isValidMIDICommands(DEFAULT_RYTHM_PS), "Invalid default RYTHM P/S commands");
+static_assert(isValidMIDICommands(DEFAULT_TAP_TEMPO), "Invalid default TAP TEMPO commands");
+static_assert(isValidMIDICommands(DEFAULT_PATTERN_INC), "Invalid default PATTERN commands");
+static_assert(isValidMIDICommands(DEFAULT_PATTERN_DEC), "Invalid default PATTERN commands");
+static_assert(isValidMIDICommands(DEFAULT_MEM_INC), "Invalid default MEM INC commands");
+static_assert(isValidMIDICommands(DEFAULT_MEM_DEC), "Invalid default MEM DEC commands");
+
 void setup()
 {
     pinMode(LED_BUILTIN_AUX, OUTPUT);
@@ -362,12 +851,22 @@ void setup()
 
     // Set serial data rate for on MIDI OUT port
     MIDI_OUT_Serial.begin(31250);
+#ifdef MIDI_UART0_PORT
+    Serial.begin(31250);
+#endif
+#ifdef SERIAL_CONFIG_PROTOCOL
+    Serial.begin(SERIAL_PROTOCOL_BAUD);
+#endif
 
 #ifdef DEBUG
     Serial.begin(9600);
     Serial.println("MIDI Pedal ESP8266");
 #endif
 
+    storage.begin(); // Start the flash file system
+
+    wifiSetup();
+    serverSetup();
     serverStarted = serverStart();
 
     if (!serverStarted)
@@ -376,137 +875,76 @@ void setup()
         digitalWrite(LED_BUILTIN_AUX, HIGH);
     }
 
-    btn1.attachClick([]() {
-        push(1);
-    });
-
-    btn1.attachDoubleClick([]() {
-        doublepush(1);
-    });
-
-    btn1.attachDuringLongPress([]() {
-        hold(1);
-    });
-
-    btn1.attachLongPressStart([]() {
-        longPressStart(1);
-    });
-
-    btn2.attachClick([]() {
-        push(2);
-    });
-
-    btn2.attachDoubleClick([]() {
-        doublepush(2);
-    });
-
-    btn2.attachDuringLongPress([]() {
-        hold(2);
-    });
-
-    btn2.attachLongPressStart([]() {
-        longPressStart(2);
-    });
-
-    btn3.attachClick([]() {
-        push(3);
-    });
-
-    btn3.attachDoubleClick([]() {
-        doublepush(3);
-    });
-
-    btn3.attachDuringLongPress([]() {
-        hold(3);
-    });
-
-    btn3.attachLongPressStart([]() {
-        longPressStart(3);
-    });
-
-    btn4.attachClick([]() {
-        push(4);
-    });
-
-    btn4.attachDoubleClick([]() {
-        doublepush(4);
-    });
-
-    btn4.attachDuringLongPress([]() {
-        hold(4);
-    });
-
-    btn4.attachLongPressStart([]() {
-        longPressStart(4);
-    });
-
-    btn5.attachClick([]() {
-        push(5);
-    });
+    footswitches.begin();
+#ifdef LIGHT_SLEEP_WAKE_PIN
+    pinMode(LIGHT_SLEEP_WAKE_PIN, INPUT_PULLUP);
+#endif
 
-    btn5.attachDoubleClick([]() {
-        doublepush(5);
-    });
+    for (uint8_t i = 0; i < BUTTON_COUNT; i++)
+    {
+        // Callbacks get the 1-based button number
+        void *btn = (void *)(intptr_t)(i + 1);
 
-    btn5.attachDuringLongPress([]() {
-        hold(5);
-    });
+        footswitches[i].attachClick([](void *btn) {
+            push((intptr_t)btn);
+        }, btn);
 
-    btn5.attachLongPressStart([]() {
-        longPressStart(5);
-    });
+        footswitches[i].attachDoubleClick([](void *btn) {
+            doublepush((intptr_t)btn);
+        }, btn);
 
-    btn6.attachClick([]() {
-        push(6);
-    });
+        footswitches[i].attachDuringLongPress([](void *btn) {
+            hold((intptr_t)btn);
+        }, btn);
 
-    btn6.attachDoubleClick([]() {
-        doublepush(6);
-    });
-
-    btn6.attachDuringLongPress([]() {
-        hold(6);
-    });
+        footswitches[i].attachLongPressStart([](void *btn) {
+            longPressStart((intptr_t)btn);
+        }, btn);
+    }
 
     initMIDIButtons();
 
+#ifdef HEAP_STATS
+    sampleHeap(HEAP_BOOT);
+#endif
+
     // Some default MIDI commands
     if (midiButtons[0].push.count == 0)
     {
-        midiButtons[0].push = parseMIDICommands("CC 1 80 127, CC 1 80 0"); // TRK P/S
+        loadMIDICommands(midiButtons[0].push, DEFAULT_TRK_PS);
     }
 
     if (midiButtons[0].hold.count == 0)
     {
-        midiButtons[0].hold = parseMIDICommands("CC 1 81 127, CC 1 81 0"); // TRK CLR
+        loadMIDICommands(midiButtons[0].hold, DEFAULT_TRK_CLR);
     }
 
     if (midiButtons[1].push.count == 0)
     {
-        midiButtons[1].push = parseMIDICommands("CC 1 82 127, CC 1 82 0"); // UNDO/REDO
+        loadMIDICommands(midiButtons[1].push, DEFAULT_UNDO_REDO);
     }
 
     if (midiButtons[1].hold.count == 0)
     {
-        midiButtons[1].hold = parseMIDICommands("CC 1 82 127, CC 1 82 0"); // UNDO/REDO
+        loadMIDICommands(midiButtons[1].hold, DEFAULT_UNDO_REDO);
     }
 
     if (midiButtons[2].push.count == 0)
     {
-        midiButtons[2].push = parseMIDICommands("CC 1 83 127, CC 1 83 0"); // RYTHM P/S
+        loadMIDICommands(midiButtons[2].push, DEFAULT_RYTHM_PS);
     }
 
     if (midiButtons[3].push.count == 0)
     {
-        midiButtons[3].push = parseMIDICommands("CC 1 84 127, CC 1 84 0"); // TAP TEMPO
+        loadMIDICommands(midiButtons[3].push, DEFAULT_TAP_TEMPO);
     }
 
     if (midiButtons[4].push.count == 0)
     {
-        midiButtons[4].push = parseMIDICommands("VAR_INC 1 1, CC 1 85 VAR, CC 1 85 127"); // PATTERN
-        midiButtons[4].hold = parseMIDICommands("VAR_INC 1 1, CC 1 85 VAR, CC 1 85 127"); // PATTERN
+        loadMIDICommands(midiButtons[4].push, DEFAULT_PATTERN_INC);
+        loadMIDICommands(midiButtons[4].hold, DEFAULT_PATTERN_INC);
         midiButtons[4].flags.repeatOnHold = true;
-        midiButtons[4].doublePush = parseMIDICommands("VAR_DEC 1 1, CC 1 85 VAR, CC 1 85 127"); // PATTERN
+        loadMIDICommands(midiButtons[4].doublePush, DEFAULT_PATTERN_DEC);
         midiButtons[4].var.min = 0;
         midiButtons[4].var.max = 56;
         midiButtons[4].var.value = 23;
@@ -514,63 +952,154 @@ void setup()
 
     if (midiButtons[5].push.count == 0)
     {
-        midiButtons[5].push = parseMIDICommands("CC 1 86 127, CC 1 86 0"); // MEM INC
+        loadMIDICommands(midiButtons[5].push, DEFAULT_MEM_INC);
     }
 
     if (midiButtons[5].hold.count == 0)
     {
-        midiButtons[5].hold = parseMIDICommands("CC 1 87 127,CC 1 87 0"); // MEM DEC
+        loadMIDICommands(midiButtons[5].hold, DEFAULT_MEM_DEC);
         midiButtons[5].flags.repeatOnHold = true;
     }
+
+    // After the defaults, which may add double push commands
+    applyButtonTimings();
+
+#ifdef STORAGE_BENCHMARK
+    // Compare the flash backend with RAM, on the same web asset and the configuration in use
+    benchmarkStorage<BUTTON_COUNT>(STORAGE_NAME, storage, midiButtons);
+    fs::FS ramStorage(std::make_shared<RAMFSImpl>());
+    File asset = storage.open(WEB_ROOT "/index.html.gz", "r");
+    File ramAsset = ramStorage.open(WEB_ROOT "/index.html.gz", "w");
+    while (asset && asset.available())
+    {
+        ramAsset.write(asset.read());
+    }
+    asset.close();
+    ramAsset.close();
+    benchmarkStorage<BUTTON_COUNT>("RAM", ramStorage, midiButtons);
+#endif
 }
 
 void loop()
 {
+    // Loop period of the current mode
+    const unsigned long loopUs = micros();
+    if (lastLoopUs != 0)
+    {
+        loopJitter[performanceMode].add(loopUs - lastLoopUs);
+    }
+    lastLoopUs = loopUs;
 
     if (serverStarted)
     {
         MDNS.update();
-        server.handleClient();
     }
 
-    btn1.tick();
-    btn2.tick();
-    btn3.tick();
-    btn4.tick();
-    btn5.tick();
-    btn6.tick();
-}
+    // Save the configuration received by the web server or the serial protocol, all buttons in a single transaction
+    if (configChanged)
+    {
+        configChanged = false;
+        for (uint8_t i = 0; i < BUTTON_COUNT; i++)
+        {
+            configJournal.saveButton(i, i == BUTTON_COUNT - 1);
+        }
+        applyButtonTimings();
 
-String getContentType(String filename)
-{ // convert the file extension to the MIME type
-    if (filename.endsWith(".html"))
-        return "text/html";
-    else if (filename.endsWith(".css"))
-        return "text/css";
-    else if (filename.endsWith(".js"))
-        return "application/javascript";
-    else if (filename.endsWith(".ico"))
-        return "image/x-icon";
-    return "text/plain";
-}
+        // Let the network know about the new configuration hash
+        if (serverStarted)
+        {
+            MDNS.announce();
+        }
+    }
 
-bool handleFileRead(String path)
-{ // send the right file to the client (if it exists)
 #ifdef DEBUG
-    Serial.println("handleFileRead: " + path);
-#endif
-    if (path.endsWith("/"))
-        path += "index.html";                        // If a folder is requested, send the index file
-    const String contentType = getContentType(path); // Get the MIME type
-    if (SPIFFS.exists(path))
-    {                                                       // If the file exists
-        File file = SPIFFS.open(path, "r");                 // Open it
-        size_t sent = server.streamFile(file, contentType); // And send it to the client
-        file.close();                                       // Then close the file again
-        return true;
+    const unsigned long scanStart = micros();
+#endif
+
+    footswitches.tick();
+
+#ifdef EXPRESSION_PEDAL
+    expressionPedal.update();
+#endif
+
+    updateSysexStream();
+
+    updateMIDIPorts();
+
+#ifdef SERIAL_CONFIG_PROTOCOL
+    serialProtocol.update();
+#endif
+
+    // The gesture toggles the performance mode once per press of the two buttons.
+    // Their callbacks come at least a debounce time after the raw press, the chord is
+    // set before any of them
+    static bool gestureLatched = false;
+    OneButton &firstButton = footswitches[0];
+    OneButton &lastButton = footswitches[BUTTON_COUNT - 1];
+    if (footswitches.isPressed(0) && footswitches.isPressed(BUTTON_COUNT - 1))
+    {
+        gestureChord = true;
     }
+    else if (firstButton.isIdle() && lastButton.isIdle() && !footswitches.isPressed(0) && !footswitches.isPressed(BUTTON_COUNT - 1))
+    {
+        gestureChord = false;
+    }
+    const bool gesture = firstButton.isLongPressed() && lastButton.isLongPressed() &&
+                         firstButton.getPressedMs() > PERFORMANCE_GESTURE_MS && lastButton.getPressedMs() > PERFORMANCE_GESTURE_MS;
+    if (gesture && !gestureLatched)
+    {
+        performanceMode ? leavePerformanceMode() : enterPerformanceMode();
+    }
+    gestureLatched = gesture;
+
+    if (PERFORMANCE_MODE_IDLE_MS > 0 && !performanceMode && !configChanged && httpConnections == 0 &&
+        millis() - lastHttpRequestMs > PERFORMANCE_MODE_IDLE_MS)
+    {
+        enterPerformanceMode();
+    }
+
+    // Journal compaction waits for the footswitches to be idle
+    if (footswitches.isIdle())
+    {
+        configJournal.update();
+    }
+
+#ifdef LIGHT_SLEEP
+    // Sleep only with the web server off, no footswitch pressed, no gesture in progress and
+    // nothing left to send. A press seen after a wake isn't debounced yet, so OneButton is still idle
+    lightSleep.update(!footswitches.anyPressed() && footswitches.isIdle() && midiPortsIdle(MIDI_ENABLED_PORTS) && !sysexStream.active);
+    if (performanceMode && !configChanged && lightSleep.canSleep())
+    {
+        lightSleep.sleep();
+        // The sleep is not part of the loop period
+        lastLoopUs = 0;
+    }
+#endif
+
 #ifdef DEBUG
-    Serial.println("\tFile Not Found");
+    // Report the worst footswitch scan time every 10 seconds
+    static unsigned long maxScanUs = 0;
+    static unsigned long lastScanReport = 0;
+    maxScanUs = max(maxScanUs, micros() - scanStart);
+    if (millis() - lastScanReport > 10000)
+    {
+        Serial.println("Max scan time for " + String(BUTTON_COUNT) + " buttons: " + String(maxScanUs) + " us");
+#ifdef EXPRESSION_PEDAL
+        Serial.println("Expression pedal " + String(expressionPedal.value) + ", " + String(expressionPedal.sent) + " sent, " +
+                       String(expressionPedal.dropped) + " dropped");
+#endif
+#ifdef LIGHT_SLEEP
+        Serial.print("Light sleep: ");
+        lightSleep.print(Serial);
+        Serial.println();
 #endif
-    return false; // If the file doesn't exist, return false
-}
\ No newline at end of file
+        Serial.print("Loop jitter normal: ");
+        loopJitter[0].print(Serial);
+        Serial.print(" performance: ");
+        loopJitter[1].print(Serial);
+        Serial.println();
+        maxScanUs = 0;
+        lastScanReport = millis();
+    }
+#endif
+}
@@ -1,5 +1,9 @@
 
-#include <FS.h> // Include the SPIFFS library
+#include "storage.h"
+#ifdef MIDI_NETWORK_HOST
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#endif
 
 // RC-5 control change supported
 /*
@@ -19,12 +23,30 @@ CC#87 FUNC
 // Led pin are 2 and 16
 // Serial is 1 and 3
 // Serial1 is 2 D4
+// Pins can be overridden from the build flags, e.g. to run on simulated GPIO
+#ifndef BUTTON_PIN1
 #define BUTTON_PIN1 10 //
+#endif
+#ifndef BUTTON_PIN2
 #define BUTTON_PIN2 D1 // 5
+#endif
+#ifndef BUTTON_PIN3
 #define BUTTON_PIN3 D2 // 4
+#endif
+#ifndef BUTTON_PIN4
 #define BUTTON_PIN4 D3 // 0
+#endif
+#ifndef BUTTON_PIN5
 #define BUTTON_PIN5 D6 // 12
+#endif
+#ifndef BUTTON_PIN6
 #define BUTTON_PIN6 D7 // 13
+#endif
+
+// 74HC165 shift register chain (SHIFT_REGISTER_INPUT)
+// SH/LD is D8, CLK is D5 (SCK), QH is D6 (MISO)
+#define SHIFT_REGISTER_LOAD_PIN D8 // 15
+#define SHIFT_REGISTER_SPI_FREQUENCY 1000000
 
 // MIDI OUT serial port 1
 #define MIDI_OUT_Serial Serial1
@@ -42,6 +64,18 @@ const uint8_t PITCH_BEND = 0xE0;
 const uint8_t VAR_INC = 0xF0;
 const uint8_t VAR_DEC = 0xF1;
 
+// Custom MIDI message types for 14-bit controllers, expanded into CC or pitch bend messages on send
+const uint8_t NRPN = 0xF2;
+const uint8_t RPN = 0xF3;
+const uint8_t CC14 = 0xF4;
+const uint8_t PITCH_BEND14 = 0xF5;
+
+// Custom MIDI message type for SysEx dumps streamed from /sysex<BYTE1>.syx
+const uint8_t SYSEX = 0xF6;
+
+// Marker for data bytes replaced by the current button VAR value
+const int MIDI_VAR = -255;
+
 // MIDI notes
 const uint8_t note_A1 = 21;
 const uint8_t note_C9 = 108;
@@ -82,19 +116,558 @@ const uint8_t channel = 1;
 const uint8_t tempo = 110;                // Tempo in beats per minute
 const int eight_note = 60000 / tempo / 2; // 8th note duration in milliseconds
 
-void sendMIDI(uint8_t messageType, uint8_t channel, uint8_t dataByte1, uint8_t dataByte2 = 0)
+// Running status and selected (N)RPN parameters are refreshed after this
+// idle time, so a device plugged in later still gets full messages
+#define RUNNING_STATUS_TIMEOUT_MS 1000
+
+// MIDI output ports, a command can target several of them (see parseMIDICommands)
+const uint8_t MIDI_PORT_SERIAL1 = 1; // DIN port on Serial1 TX (D4)
+const uint8_t MIDI_PORT_UART0 = 2;   // Second DIN port on UART0 TX (MIDI_UART0_PORT, without DEBUG)
+const uint8_t MIDI_PORT_NETWORK = 4; // UDP datagrams to MIDI_NETWORK_HOST (a network sink)
+const uint8_t MIDI_PORT_COUNT = 3;
+
+#ifndef MIDI_DEFAULT_PORTS
+#define MIDI_DEFAULT_PORTS MIDI_PORT_SERIAL1
+#endif
+#ifndef MIDI_NETWORK_UDP_PORT
+#define MIDI_NETWORK_UDP_PORT 21928
+#endif
+
+#if defined(MIDI_UART0_PORT) && defined(DEBUG)
+#error "UART0 is the debug console, MIDI_UART0_PORT needs DEBUG off"
+#endif
+#if defined(SERIAL_CONFIG_PROTOCOL) && (defined(DEBUG) || defined(MIDI_UART0_PORT))
+#error "SERIAL_CONFIG_PROTOCOL needs UART0 for itself, without DEBUG and MIDI_UART0_PORT"
+#endif
+
+// Ports built in, the others are ignored
+#if defined(MIDI_UART0_PORT) && defined(MIDI_NETWORK_HOST)
+const uint8_t MIDI_ENABLED_PORTS = MIDI_PORT_SERIAL1 | MIDI_PORT_UART0 | MIDI_PORT_NETWORK;
+#elif defined(MIDI_UART0_PORT)
+const uint8_t MIDI_ENABLED_PORTS = MIDI_PORT_SERIAL1 | MIDI_PORT_UART0;
+#elif defined(MIDI_NETWORK_HOST)
+const uint8_t MIDI_ENABLED_PORTS = MIDI_PORT_SERIAL1 | MIDI_PORT_NETWORK;
+#else
+const uint8_t MIDI_ENABLED_PORTS = MIDI_PORT_SERIAL1;
+#endif
+
+// Transmit FIFO of the ESP8266 UARTs
+#define MIDI_UART_FIFO_SIZE 128
+
+// Bytes buffered for each port, messages that don't fit are dropped whole
+#define MIDI_PORT_BUFFER_SIZE 128
+// Messages sent to a port while a SysEx message is in progress on it wait here until it ends,
+// a SysEx dump leaves as much room in the buffer for them
+#define MIDI_PORT_PENDING_SIZE 48
+static_assert(MIDI_PORT_PENDING_SIZE < MIDI_PORT_BUFFER_SIZE, "The pending messages must fit in the port buffer");
+
+// Error messages go to the UART0 console, which is silent when it is a MIDI port or
+// carries the serial configuration protocol
+void logError(const String &message)
+{
+#if !defined(MIDI_UART0_PORT) && !defined(SERIAL_CONFIG_PROTOCOL)
+    Serial.println(message);
+#endif
+}
+
+#ifdef SERIAL_CONFIG_PROTOCOL
+// Called for each channel message sent, to monitor them over the serial protocol
+void onMIDIMessage(const uint8_t *message, uint8_t length, uint8_t ports);
+#endif
+
+// State of a MIDI output port. Messages are encoded once and appended to the buffer of
+// each target port, loop() drains every buffer without blocking so a slow port
+// never delays the others.
+struct MIDIOutputPort
+{
+    uint8_t buffer[MIDI_PORT_BUFFER_SIZE];
+    uint16_t head = 0;
+    uint16_t count = 0;
+    // Last status byte sent, 0 when the next message must send it
+    uint8_t runningStatus = 0;
+    // Last (N)RPN parameter selected on each channel, bit 15 set for RPN, 0xFFFF when unknown
+    uint16_t selectedParameter[16] = {0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF,
+                                      0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFF};
+    unsigned long lastSendMs = 0;
+    // A SysEx message was started (F0) and not yet ended (F7) on this port
+    bool inSysex = false;
+    uint8_t pending[MIDI_PORT_PENDING_SIZE];
+    uint8_t pendingCount = 0;
+
+    // Statistics: bytes written to the port, bytes dropped because the buffer was full,
+    // time to drain the buffer since it stopped being empty (last and worst)
+    uint32_t bytesSent = 0;
+    uint32_t bytesDropped = 0;
+    unsigned long queuedUs = 0;
+    uint32_t lastLatencyUs = 0;
+    uint32_t maxLatencyUs = 0;
+
+    uint16_t room() const
+    {
+        return inSysex ? sizeof(pending) - pendingCount : sizeof(buffer) - count;
+    }
+
+    // Append bytes to the buffer, all or none. After a drop the next message sends its status byte
+    bool append(const uint8_t *bytes, uint8_t length)
+    {
+        if (count + length > sizeof(buffer))
+        {
+            bytesDropped += length;
+            runningStatus = 0;
+            return false;
+        }
+        if (count == 0)
+        {
+            queuedUs = micros();
+        }
+        for (uint8_t i = 0; i < length; i++)
+        {
+            buffer[(head + count++) % sizeof(buffer)] = bytes[i];
+        }
+        return true;
+    }
+
+    // Remove bytes written to the port from the buffer
+    void consume(uint16_t length)
+    {
+        head = (head + length) % sizeof(buffer);
+        count -= length;
+        bytesSent += length;
+        if (count == 0)
+        {
+            lastLatencyUs = micros() - queuedUs;
+            maxLatencyUs = max(maxLatencyUs, lastLatencyUs);
+        }
+    }
+};
+
+MIDIOutputPort midiPorts[MIDI_PORT_COUNT];
+
+#ifdef MIDI_NETWORK_HOST
+WiFiUDP midiUDP;
+#endif
+
+// Port i of midiPorts is MIDI_PORT_* bit i, ports not built in are never selected
+bool isMIDIPortSelected(uint8_t ports, uint8_t i)
+{
+    return ports & MIDI_ENABLED_PORTS & (1 << i);
+}
+
+void resetMIDIOutputState(MIDIOutputPort &port)
+{
+    port.runningStatus = 0;
+    for (uint8_t i = 0; i < 16; i++)
+    {
+        port.selectedParameter[i] = 0xFFFF;
+    }
+}
+
+void refreshMIDIOutputState(MIDIOutputPort &port)
+{
+    if (millis() - port.lastSendMs > RUNNING_STATUS_TIMEOUT_MS)
+    {
+        resetMIDIOutputState(port);
+    }
+    port.lastSendMs = millis();
+}
+
+// Queue an encoded message on a port, without the status byte when running status applies.
+// The network port always sends it, every datagram stands on its own.
+void queueMIDIMessage(uint8_t portIndex, const uint8_t *message, uint8_t length)
+{
+    MIDIOutputPort &port = midiPorts[portIndex];
+    const bool running = message[0] == port.runningStatus && (1 << portIndex) != MIDI_PORT_NETWORK;
+    const uint8_t *bytes = running ? message + 1 : message;
+    const uint8_t byteCount = running ? length - 1 : length;
+
+    if (port.inSysex)
+    {
+        if (port.pendingCount + byteCount > sizeof(port.pending))
+        {
+            port.bytesDropped += byteCount;
+            port.runningStatus = 0;
+#ifdef DEBUG
+            Serial.println("MIDI message dropped during SysEx dump");
+#endif
+            return;
+        }
+        memcpy(port.pending + port.pendingCount, bytes, byteCount);
+        port.pendingCount += byteCount;
+    }
+    else if (!port.append(bytes, byteCount))
+    {
+        return;
+    }
+    port.runningStatus = message[0];
+}
+
+HardwareSerial &midiPortSerial(uint8_t i)
+{
+    return (1 << i) == MIDI_PORT_UART0 ? Serial : MIDI_OUT_Serial;
+}
+
+// Write what each port takes without blocking, call it from loop()
+void updateMIDIPorts()
+{
+    for (uint8_t i = 0; i < MIDI_PORT_COUNT; i++)
+    {
+        if (!isMIDIPortSelected(0xFF, i))
+        {
+            continue;
+        }
+        MIDIOutputPort &port = midiPorts[i];
+        if (port.count == 0)
+        {
+            continue;
+        }
+
+        if ((1 << i) == MIDI_PORT_NETWORK)
+        {
+#ifdef MIDI_NETWORK_HOST
+            // Everything buffered goes in one datagram, nothing is kept while disconnected
+            if (WiFi.status() == WL_CONNECTED)
+            {
+                midiUDP.beginPacket(MIDI_NETWORK_HOST, MIDI_NETWORK_UDP_PORT);
+                const uint16_t first = min(port.count, (uint16_t)(sizeof(port.buffer) - port.head));
+                midiUDP.write(port.buffer + port.head, first);
+                midiUDP.write(port.buffer, port.count - first);
+                midiUDP.endPacket();
+                port.consume(port.count);
+            }
+            else
+            {
+                port.bytesDropped += port.count;
+                port.head = 0;
+                port.count = 0;
+            }
+#endif
+            continue;
+        }
+
+        HardwareSerial &serial = midiPortSerial(i);
+        // Only up to the end of the ring, the rest goes on the next pass
+        const int room = serial.availableForWrite();
+        const uint16_t length = min(min(port.count, (uint16_t)(sizeof(port.buffer) - port.head)), (uint16_t)max(room, 0));
+        if (length > 0)
+        {
+            serial.write(port.buffer + port.head, length);
+            port.consume(length);
+        }
+    }
+}
+
+// Smallest room for a message on the ports
+uint16_t midiPortsRoom(uint8_t ports)
 {
+    uint16_t room = MIDI_PORT_BUFFER_SIZE;
+    for (uint8_t i = 0; i < MIDI_PORT_COUNT; i++)
+    {
+        if (!isMIDIPortSelected(ports, i))
+        {
+            continue;
+        }
+        room = min(room, midiPorts[i].room());
+    }
+    return room;
+}
 
+// Nothing is waiting to be sent on the ports, at most a message is still in the UART FIFOs
+bool midiPortsIdle(uint8_t ports)
+{
+    for (uint8_t i = 0; i < MIDI_PORT_COUNT; i++)
+    {
+        if (!isMIDIPortSelected(ports, i))
+        {
+            continue;
+        }
+        if (midiPorts[i].count > 0 || midiPorts[i].inSysex)
+        {
+            return false;
+        }
+        if ((1 << i) != MIDI_PORT_NETWORK && midiPortSerial(i).availableForWrite() < MIDI_UART_FIFO_SIZE - 6)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// {"serial1":{"bytes":..,"dropped":..,"lastLatencyUs":..,"maxLatencyUs":..},"uart0":{..},"network":{..}}
+void printMIDIPortStats(Print &out)
+{
+    const char *const names[MIDI_PORT_COUNT] = {"serial1", "uart0", "network"};
+    out.print('{');
+    bool first = true;
+    for (uint8_t i = 0; i < MIDI_PORT_COUNT; i++)
+    {
+        if (!isMIDIPortSelected(0xFF, i))
+        {
+            continue;
+        }
+        const MIDIOutputPort &port = midiPorts[i];
+        if (!first)
+        {
+            out.print(',');
+        }
+        first = false;
+        out.print('"');
+        out.print(names[i]);
+        out.print("\":{\"bytes\":");
+        out.print(port.bytesSent);
+        out.print(",\"dropped\":");
+        out.print(port.bytesDropped);
+        out.print(",\"lastLatencyUs\":");
+        out.print(port.lastLatencyUs);
+        out.print(",\"maxLatencyUs\":");
+        out.print(port.maxLatencyUs);
+        out.print('}');
+    }
+    out.print('}');
+}
+
+// SysEx files are streamed in chunks of this size from loop()
+#define SYSEX_CHUNK_SIZE 32
+
+// State of the SysEx dump being streamed to the MIDI ports
+struct SysexStream
+{
+    File file;
+    bool active = false;
+    // A SysEx message was started (F0) and not yet ended (F7)
+    bool inMessage = false;
+    uint8_t ports = 0;
+    // Pause after each SysEx message, for devices that need pacing
+    uint16_t gapMs = 0;
+    unsigned long resumeMs = 0;
+    unsigned long startMs = 0;
+    uint32_t bytesSent = 0;
+};
+
+SysexStream sysexStream;
+
+// Report of the last completed SysEx dump
+uint32_t lastSysexBytes = 0;
+unsigned long lastSysexDurationMs = 0;
+
+void sendMIDI(uint8_t messageType, uint8_t channel, uint8_t dataByte1, uint8_t dataByte2 = 0, uint8_t ports = MIDI_DEFAULT_PORTS)
+{
     // Adjust zero-based MIDI channel
-    channel--;
+    channel = (channel - 1) & 0x0F;
+
+    // Create MIDI status byte, the message is encoded once for all the ports
+    const uint8_t message[3] = {(uint8_t)(0b10000000 | messageType | channel), (uint8_t)(dataByte1 & 0x7F), (uint8_t)(dataByte2 & 0x7F)};
+
+    // Program change and channel pressure have a single data byte
+    const uint8_t length = messageType != PROGRAM_CHANGE && messageType != CHANNEL_PRESSURE ? 3 : 2;
+
+#ifdef SERIAL_CONFIG_PROTOCOL
+    onMIDIMessage(message, length, ports & MIDI_ENABLED_PORTS);
+#endif
+
+    for (uint8_t i = 0; i < MIDI_PORT_COUNT; i++)
+    {
+        if (!isMIDIPortSelected(ports, i))
+        {
+            continue;
+        }
+        refreshMIDIOutputState(midiPorts[i]);
+
+        // Plain CCs selecting a parameter invalidate the (N)RPN cache
+        if (messageType == CC && dataByte1 >= 98 && dataByte1 <= 101)
+        {
+            midiPorts[i].selectedParameter[channel] = 0xFFFF;
+        }
+
+        queueMIDIMessage(i, message, length);
+    }
+
+    // Start writing right away, the rest is written from loop()
+    updateMIDIPorts();
+}
+
+// Send a 14-bit (N)RPN value, the parameter number is only sent to the ports where it changed
+void sendMIDIParameter(bool registered, uint8_t channel, uint16_t parameter, uint16_t value, uint8_t ports = MIDI_DEFAULT_PORTS)
+{
+    const uint16_t selected = (parameter & 0x3FFF) | (registered ? 0x8000 : 0);
+    uint8_t selectPorts = 0;
+    for (uint8_t i = 0; i < MIDI_PORT_COUNT; i++)
+    {
+        if (!isMIDIPortSelected(ports, i))
+        {
+            continue;
+        }
+        refreshMIDIOutputState(midiPorts[i]);
+        if (midiPorts[i].selectedParameter[(channel - 1) & 0x0F] != selected)
+        {
+            selectPorts |= 1 << i;
+        }
+    }
+
+    if (selectPorts)
+    {
+        sendMIDI(CC, channel, registered ? 101 : 99, parameter >> 7, selectPorts);
+        sendMIDI(CC, channel, registered ? 100 : 98, parameter, selectPorts);
+        for (uint8_t i = 0; i < MIDI_PORT_COUNT; i++)
+        {
+            if (!isMIDIPortSelected(selectPorts, i))
+            {
+                continue;
+            }
+            midiPorts[i].selectedParameter[(channel - 1) & 0x0F] = selected;
+        }
+    }
+
+    // Data entry MSB and LSB
+    sendMIDI(CC, channel, 6, value >> 7, ports);
+    sendMIDI(CC, channel, 38, value, ports);
+}
+
+// Send a 14-bit CC as a MSB (controller 0-31) and LSB (controller + 32) pair
+void sendMIDICC14(uint8_t channel, uint8_t ccNumber, uint16_t value, uint8_t ports = MIDI_DEFAULT_PORTS)
+{
+    sendMIDI(CC, channel, ccNumber, value >> 7, ports);
+    sendMIDI(CC, channel, ccNumber + 32, value, ports);
+}
+
+// A SysEx message ends on the ports of the stream: the messages held back follow it
+void endSysexMessage()
+{
+    sysexStream.inMessage = false;
+    for (uint8_t i = 0; i < MIDI_PORT_COUNT; i++)
+    {
+        if (!isMIDIPortSelected(sysexStream.ports, i))
+        {
+            continue;
+        }
+        MIDIOutputPort &port = midiPorts[i];
+        port.inSysex = false;
+        port.append(port.pending, port.pendingCount);
+        port.pendingCount = 0;
+    }
+}
+
+// Start streaming /sysex<number>.syx to the ports, the file is read in chunks by updateSysexStream()
+bool startSysexStream(int number, uint16_t gapMs, uint8_t ports = MIDI_DEFAULT_PORTS)
+{
+    if (sysexStream.active)
+    {
+#ifdef DEBUG
+        Serial.println("SysEx dump already in progress");
+#endif
+        return false;
+    }
+
+    const String filename = "/sysex" + String(number) + ".syx";
+    sysexStream.file = storage.open(filename, "r");
+    if (!sysexStream.file)
+    {
+        logError("Failed to open file " + filename + " for reading");
+        return false;
+    }
 
-    // Create MIDI status byte
-    uint8_t statusByte = 0b10000000 | messageType | channel;
+    sysexStream.active = true;
+    sysexStream.ports = ports & MIDI_ENABLED_PORTS;
+    sysexStream.gapMs = gapMs;
+    sysexStream.resumeMs = millis();
+    sysexStream.startMs = millis();
+    sysexStream.bytesSent = 0;
+    return true;
+}
+
+// Queue the next chunk of the SysEx dump, call it from loop()
+void updateSysexStream()
+{
+    if (!sysexStream.active || (long)(millis() - sysexStream.resumeMs) < 0)
+    {
+        return;
+    }
+
+    // Only read what the buffers of all the ports take, the slowest port paces the dump.
+    // MIDI_PORT_PENDING_SIZE bytes stay free, so the messages held back fit when the SysEx ends
+    uint8_t chunk[SYSEX_CHUNK_SIZE];
+    int room = SYSEX_CHUNK_SIZE;
+    for (uint8_t i = 0; i < MIDI_PORT_COUNT; i++)
+    {
+        if (!isMIDIPortSelected(sysexStream.ports, i))
+        {
+            continue;
+        }
+        room = min(room, (int)(sizeof(midiPorts[i].buffer) - midiPorts[i].count) - MIDI_PORT_PENDING_SIZE);
+    }
+    if (room <= 0)
+    {
+        return;
+    }
+
+    const size_t count = sysexStream.file.read(chunk, room);
+    if (count == 0)
+    {
+        // End of file, close an unterminated message anyway
+        if (sysexStream.inMessage)
+        {
+            const uint8_t end = 0xF7;
+            for (uint8_t i = 0; i < MIDI_PORT_COUNT; i++)
+            {
+                if (!isMIDIPortSelected(sysexStream.ports, i))
+                {
+                    continue;
+                }
+                midiPorts[i].append(&end, 1);
+            }
+            endSysexMessage();
+        }
+        sysexStream.file.close();
+        sysexStream.active = false;
+        lastSysexBytes = sysexStream.bytesSent;
+        lastSysexDurationMs = millis() - sysexStream.startMs;
+#ifdef DEBUG
+        Serial.println("SysEx dump sent " + String(lastSysexBytes) + " bytes in " + String(lastSysexDurationMs) + " ms (" +
+                       String(lastSysexDurationMs ? lastSysexBytes * 1000 / lastSysexDurationMs : lastSysexBytes) + " bytes/s)");
+#endif
+        return;
+    }
 
-    // Send MIDI status and data
-    MIDI_OUT_Serial.write(statusByte);
-    MIDI_OUT_Serial.write(dataByte1);
-    MIDI_OUT_Serial.write(dataByte2);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (chunk[i] == 0xF0)
+        {
+            // SysEx cancels running status on the receiver
+            sysexStream.inMessage = true;
+            for (uint8_t port = 0; port < MIDI_PORT_COUNT; port++)
+            {
+                if (!isMIDIPortSelected(sysexStream.ports, port))
+                {
+                    continue;
+                }
+                midiPorts[port].inSysex = true;
+                midiPorts[port].runningStatus = 0;
+            }
+        }
+
+        for (uint8_t port = 0; port < MIDI_PORT_COUNT; port++)
+        {
+            if (!isMIDIPortSelected(sysexStream.ports, port))
+            {
+                continue;
+            }
+            midiPorts[port].append(chunk + i, 1);
+        }
+        sysexStream.bytesSent++;
+
+        if (chunk[i] == 0xF7)
+        {
+            endSysexMessage();
+            if (sysexStream.gapMs > 0)
+            {
+                // Pause and read the rest of the chunk again later
+                sysexStream.file.seek(sysexStream.file.position() - (count - i - 1));
+                sysexStream.resumeMs = millis() + sysexStream.gapMs;
+                break;
+            }
+        }
+    }
+
+    updateMIDIPorts();
 }
 
 void sendCC(uint8_t ccNumber)
@@ -108,37 +681,140 @@ void sendNoteOn(uint8_t note, uint8_t velocity)
     sendMIDI(NOTE_ON, 1, note, velocity);
 }
 
+// Print sink writing into a fixed char buffer, output past its size is dropped and
+// the buffer is always NUL terminated
+class BufferPrint : public Print
+{
+public:
+    BufferPrint(char *buffer, size_t size) : buffer(buffer), size(size)
+    {
+        if (size > 0)
+        {
+            buffer[0] = '\0';
+        }
+    }
+
+    size_t write(uint8_t byte) override
+    {
+        if (length + 1 >= size)
+        {
+            return 0;
+        }
+        buffer[length++] = byte;
+        buffer[length] = '\0';
+        return 1;
+    }
+
+    char *buffer;
+    size_t size;
+    size_t length = 0;
+};
+
+// Print sink that only counts the bytes, to size an output before writing it
+class CountPrint : public Print
+{
+public:
+    size_t write(uint8_t byte) override
+    {
+        length++;
+        return 1;
+    }
+
+    size_t length = 0;
+};
+
+// Print sink appending to a String
+class StringPrint : public Print
+{
+public:
+    StringPrint(String &string) : string(string)
+    {
+    }
+
+    size_t write(uint8_t byte) override
+    {
+        string += (char)byte;
+        return 1;
+    }
+
+    String &string;
+};
+
+// Names of the commands in flash, indexed by the high nibble of the status byte for
+// NOTE_OFF to PITCH_BEND and by the command for VAR_INC to SYSEX
+const char MIDI_COMMAND_NAMES[][17] PROGMEM = {
+    "NOTE_OFF", "NOTE_ON", "KEY_PRESSURE", "CC", "PC", "CHANNEL_PRESSURE", "PITCH_BEND",
+    "VAR_INC", "VAR_DEC", "NRPN", "RPN", "CC14", "PITCH_BEND14", "SYSEX"};
+
+// Name of a command, nullptr if unknown
+const __FlashStringHelper *midiCommandName(uint8_t command)
+{
+    if (command >= NOTE_OFF && command <= PITCH_BEND && (command & 0x0F) == 0)
+    {
+        return FPSTR(MIDI_COMMAND_NAMES[(command >> 4) - 8]);
+    }
+    if (command >= VAR_INC && command <= SYSEX)
+    {
+        return FPSTR(MIDI_COMMAND_NAMES[7 + command - VAR_INC]);
+    }
+    return nullptr;
+}
+
 // Struct for MIDI command
 struct MIDICommand
 {
-    uint8_t command = -1;
-    uint8_t channel = 0;
-    int data1 = 0;
-    int data2 = 0;
-    String toString() const
+    uint8_t command;
+    uint8_t channel;
+    // MIDI_PORT_* bits the command is sent to, 0 for MIDI_DEFAULT_PORTS
+    uint8_t ports;
+    int data1;
+    int data2;
+
+    constexpr MIDICommand(uint8_t command = -1, uint8_t channel = 0, int data1 = 0, int data2 = 0, uint8_t ports = 0)
+        : command(command), channel(channel), ports(ports), data1(data1), data2(data2)
     {
-        String commandString = command == NOTE_OFF ? "NOTE_OFF" : command == NOTE_ON        ? "NOTE_ON"
-                                                              : command == KEY_PRESSURE     ? "KEY_PRESSURE"
-                                                              : command == CC               ? "CC"
-                                                              : command == PROGRAM_CHANGE   ? "PC"
-                                                              : command == CHANNEL_PRESSURE ? "CHANNEL_PRESSURE"
-                                                              : command == PITCH_BEND       ? "PITCH_BEND"
-                                                              : command == VAR_INC          ? "VAR_INC"
-                                                              : command == VAR_DEC          ? "VAR_DEC"
-                                                                                            : "UNKNOWN";
+    }
 
-        if (commandString == "UNKNOWN")
+    // Print as "<NAME> <channel> <data1> <data2>[ @<ports>]" without allocations, nothing for an unknown command
+    size_t printTo(Print &out) const
+    {
+        const __FlashStringHelper *name = midiCommandName(command);
+        if (!name)
         {
-            return "";
+            return 0;
+        }
+        size_t length = out.print(name);
+        length += out.print(' ');
+        length += out.print(channel);
+        length += out.print(' ');
+        length += data1 < 0 ? out.print("VAR") : out.print(data1);
+        length += out.print(' ');
+        length += data2 < 0 ? out.print("VAR") : out.print(data2);
+        if (ports != 0)
+        {
+            length += out.print(" @");
+            for (uint8_t i = 0; i < MIDI_PORT_COUNT; i++)
+            {
+                if (ports & (1 << i))
+                {
+                    length += out.print((char)('1' + i));
+                }
+            }
         }
+        return length;
+    }
 
-        commandString += " ";
-        commandString += String(channel);
-        commandString += " ";
-        commandString += data1 < 0 ? "VAR" : String(data1);
-        commandString += " ";
-        commandString += data2 < 0 ? "VAR" : String(data2);
-        return commandString;
+    // Longest printTo() output: the longest name, a uint8_t channel, two 32-bit ints (VAR
+    // when negative, so at most 10 digits) and every port, with the separators
+    static const size_t TEXT_LENGTH = (sizeof(MIDI_COMMAND_NAMES[0]) - 1) + 1 + 3 + 2 * (1 + 10) + 2 + MIDI_PORT_COUNT;
+
+    String toString() const
+    {
+        static_assert(sizeof(channel) == 1 && sizeof(data1) == 4 && sizeof(data2) == 4, "TEXT_LENGTH is out of date");
+        char buffer[TEXT_LENGTH + 1];
+        BufferPrint bufferPrint(buffer, sizeof(buffer));
+        printTo(bufferPrint);
+        return buffer;
     }
 };
 
@@ -147,26 +823,102 @@ struct MIDICommandList
 {
     MIDICommand commands[32];
     uint8_t count = 0;
-    String toString() const
+
+    // Print as a comma separated list without allocations. Unknown commands are skipped,
+    // but the comma before the next one is kept: the saved format has always been this way.
+    size_t printTo(Print &out) const
     {
-        String commandString = "";
+        size_t length = 0;
         for (int i = 0; i < count; i++)
         {
-            const String currentCommandString = commands[i].toString();
-            if (currentCommandString == "")
+            if (!midiCommandName(commands[i].command))
             {
                 continue;
             }
             if (i > 0)
             {
-                commandString += ",";
+                length += out.print(',');
             }
-            commandString += currentCommandString;
+            length += commands[i].printTo(out);
         }
+        return length;
+    }
+
+    // Print into buffer, truncated to its size, returns the length written
+    size_t toChars(char *buffer, size_t size) const
+    {
+        BufferPrint bufferPrint(buffer, size);
+        printTo(bufferPrint);
+        return bufferPrint.length;
+    }
+
+    String toString() const
+    {
+        CountPrint countPrint;
+        String commandString;
+        commandString.reserve(printTo(countPrint));
+        StringPrint stringPrint(commandString);
+        printTo(stringPrint);
         return commandString;
     }
 };
 
+// Compile time validation of MIDI commands defined in code (see the default commands in main.cpp)
+constexpr bool isValidMIDIData(int data)
+{
+    return data == MIDI_VAR || (data >= 0 && data <= 127);
+}
+
+constexpr bool isValidMIDIData14(int data)
+{
+    return data == MIDI_VAR || (data >= 0 && data <= 16383);
+}
+
+constexpr bool isValidMIDIChannel(uint8_t channel)
+{
+    return channel >= 1 && channel <= 16;
+}
+
+constexpr bool isValidMIDICommandData(const MIDICommand &command)
+{
+    // Channel and BYTE2 are ignored by VAR_INC and VAR_DEC, BYTE2 is ignored by PITCH_BEND14,
+    // channel is ignored by SYSEX
+    return (command.command == VAR_INC || command.command == VAR_DEC)
+               ? command.data1 >= 0 && command.data1 <= 16383
+           : command.command == SYSEX
+               ? isValidMIDIData14(command.data1) && command.data2 >= 0 && command.data2 <= 16383
+           : (command.command == NRPN || command.command == RPN)
+               ? isValidMIDIChannel(command.channel) && isValidMIDIData14(command.data1) && isValidMIDIData14(command.data2)
+           : command.command == CC14
+               ? isValidMIDIChannel(command.channel) && command.data1 >= 0 && command.data1 <= 31 && isValidMIDIData14(command.data2)
+           : command.command == PITCH_BEND14
+               ? isValidMIDIChannel(command.channel) && isValidMIDIData14(command.data1)
+               : (command.command == NOTE_OFF || command.command == NOTE_ON || command.command == KEY_PRESSURE ||
+                  command.command == CC || command.command == PROGRAM_CHANGE || command.command == CHANNEL_PRESSURE ||
+                  command.command == PITCH_BEND) &&
+                     isValidMIDIChannel(command.channel) && isValidMIDIData(command.data1) && isValidMIDIData(command.data2);
+}
+
+constexpr bool isValidMIDICommand(const MIDICommand &command)
+{
+    return command.ports < (1 << MIDI_PORT_COUNT) && isValidMIDICommandData(command);
+}
+
+template <size_t N>
+constexpr bool isValidMIDICommands(const MIDICommand (&commands)[N], size_t i = 0)
+{
+    return N <= 32 && (i == N || (isValidMIDICommand(commands[i]) && isValidMIDICommands(commands, i + 1)));
+}
+
+// Copy a command table stored in flash (PROGMEM) into a command list
+template <size_t N>
+void loadMIDICommands(MIDICommandList &commandList, const MIDICommand (&commands)[N])
+{
+    static_assert(N <= 32, "Too many MIDI commands");
+    memcpy_P(commandList.commands, commands, sizeof(commands));
+    commandList.count = N;
+}
+
 struct MIDICommandFlags
 {
     bool repeatOnHold = false;
@@ -215,26 +967,12 @@ struct MIDIButtonCommands
     MDIDIButtonVar var;
 };
 
-void saveMIDIButtonVar(const MIDIButtonCommands &button, const String &filename)
-{
-    File file = SPIFFS.open(filename + ".var", "w");
-    if (!file)
-    {
-        Serial.println("Failed to open file " + filename + ".var for writing");
-    }
-    else
-    {
-        file.print(button.var.value);
-        file.println();
-        file.print(button.var.min);
-        file.println();
-        file.print(button.var.max);
-        file.println();
-        file.print(button.var.step);
-        file.println();
-        file.close();
-    }
-}
+// Memory budget of a button, all of them are kept in RAM: growing it must be a deliberate change
+#define MIDI_BUTTON_COMMANDS_SIZE_BUDGET 1184
+static_assert(sizeof(MIDIButtonCommands) <= MIDI_BUTTON_COMMANDS_SIZE_BUDGET, "MIDIButtonCommands is over its memory budget");
+
+// Called when VAR_INC or VAR_DEC changed the VAR of a button, to persist it
+void onMIDIButtonVarChanged(MIDIButtonCommands &button);
 
 // Send Midi command list
 void sendMIDICommandList(const MIDICommandList &commandList, MIDIButtonCommands &button)
@@ -247,9 +985,11 @@ void sendMIDICommandList(const MIDICommandList &commandList, MIDIButtonCommands
     else
     {
         Serial.println("Send MIDI command list");
-        Serial.println(commandList.toString());
+        commandList.printTo(Serial);
+        Serial.println();
     }
 #endif
+    bool varChanged = false;
     for (int i = 0; i < commandList.count; i++)
     {
         MIDICommand command = commandList.commands[i];
@@ -262,8 +1002,7 @@ void sendMIDICommandList(const MIDICommandList &commandList, MIDIButtonCommands
             {
                 button.var.value = button.var.min;
             }
-            // Write value to file
-            saveMIDIButtonVar(button, "button" + String(i + 1));
+            varChanged = true;
             continue;
         }
         else if (command.command == VAR_DEC)
@@ -273,27 +1012,55 @@ void sendMIDICommandList(const MIDICommandList &commandList, MIDIButtonCommands
             {
                 button.var.value = button.var.max;
             }
-            // Write value to file
-            saveMIDIButtonVar(button, "button" + String(i + 1));
+            varChanged = true;
             continue;
         }
 
+        const uint8_t ports = command.ports ? command.ports : MIDI_DEFAULT_PORTS;
+
         // Replace VAR with current value
-        if (command.data1 == -255)
+        if (command.data1 == MIDI_VAR)
         {
             command.data1 = button.var.value;
         }
-        if (command.data2 == -255)
+        if (command.data2 == MIDI_VAR)
         {
             command.data2 = button.var.value;
         }
 
-        sendMIDI(command.command, command.channel, command.data1, command.data2);
+        // Expand 14-bit commands
+        if (command.command == NRPN || command.command == RPN)
+        {
+            sendMIDIParameter(command.command == RPN, command.channel, command.data1, command.data2, ports);
+        }
+        else if (command.command == CC14)
+        {
+            sendMIDICC14(command.channel, command.data1, command.data2, ports);
+        }
+        else if (command.command == PITCH_BEND14)
+        {
+            sendMIDI(PITCH_BEND, command.channel, command.data1, command.data1 >> 7, ports);
+        }
+        else if (command.command == SYSEX)
+        {
+            startSysexStream(command.data1, command.data2, ports);
+        }
+        else
+        {
+            sendMIDI(command.command, command.channel, command.data1, command.data2, ports);
+        }
+    }
+
+    // Write value to flash once the MIDI commands are out
+    if (varChanged)
+    {
+        onMIDIButtonVarChanged(button);
     }
 }
 
-// Parse MIDI commands from a string containing a comma-separated list of commands
-MIDICommandList parseMIDICommands(String commandString)
+// Parse MIDI commands from a string containing a comma-separated list of commands,
+// valid (when given) is cleared if any command is unknown, malformed or out of range
+MIDICommandList parseMIDICommands(String commandString, bool *valid = nullptr)
 {
 
 #ifdef DEBUG
@@ -324,6 +1091,30 @@ MIDICommandList parseMIDICommands(String commandString)
         Serial.println("Parsing command " + command);
 #endif
 
+        // Optional output ports after a @, e.g. "CC 1 80 127 @12" for Serial1 and UART0
+        uint8_t ports = 0;
+        const int portsStart = command.indexOf('@');
+        if (portsStart != -1)
+        {
+            for (unsigned int i = portsStart + 1; i < command.length(); i++)
+            {
+                const char port = command.charAt(i);
+                if (port >= '1' && port < '1' + MIDI_PORT_COUNT)
+                {
+                    ports |= 1 << (port - '1');
+                }
+                else if (port != ' ' && valid)
+                {
+                    *valid = false;
+                }
+            }
+            if (ports == 0 && valid)
+            {
+                *valid = false;
+            }
+            command = command.substring(0, portsStart);
+        }
+
         // Split command into parts
         int partStart = 0;
         int partEnd = command.indexOf(' ');
@@ -337,13 +1128,20 @@ MIDICommandList parseMIDICommands(String commandString)
 
         String parts[4];
         int partIndex = 0;
-        while (partEnd != -1)
+        while (partEnd != -1 && partIndex < 3)
         {
             parts[partIndex++] = command.substring(partStart, partEnd);
             partStart = partEnd + 1;
             partEnd = command.indexOf(' ', partStart);
         }
-        parts[partIndex++] = command.substring(partStart);
+        parts[partIndex] = command.substring(partStart);
+        parts[partIndex].trim();
+
+        // More than 4 parts
+        if (valid && parts[partIndex].indexOf(' ') != -1)
+        {
+            *valid = false;
+        }
 
         // Parse command
         MIDICommand midiCommand;
@@ -387,6 +1185,26 @@ MIDICommandList parseMIDICommands(String commandString)
         {
             midiCommand.command = VAR_DEC;
         }
+        else if (commandType == "NRPN")
+        {
+            midiCommand.command = NRPN;
+        }
+        else if (commandType == "RPN")
+        {
+            midiCommand.command = RPN;
+        }
+        else if (commandType == "CC14")
+        {
+            midiCommand.command = CC14;
+        }
+        else if (commandType == "PITCH_BEND14")
+        {
+            midiCommand.command = PITCH_BEND14;
+        }
+        else if (commandType == "SYSEX")
+        {
+            midiCommand.command = SYSEX;
+        }
         else
         {
             midiCommand.command = -1;
@@ -395,14 +1213,15 @@ MIDICommandList parseMIDICommands(String commandString)
 #endif
         }
 
-        if (midiCommand.command != -1 && commandList.count < 32)
+        if (midiCommand.command != (uint8_t)-1 && commandList.count < 32)
         {
 
             midiCommand.channel = parts[1].toInt();
+            midiCommand.ports = ports;
             // Parse VAR
             if (parts[2] == "VAR")
             {
-                midiCommand.data1 = -255;
+                midiCommand.data1 = MIDI_VAR;
             }
             else
             {
@@ -410,16 +1229,25 @@ MIDICommandList parseMIDICommands(String commandString)
             }
             if (parts[3] == "VAR")
             {
-                midiCommand.data2 = -255;
+                midiCommand.data2 = MIDI_VAR;
             }
             else
             {
                 midiCommand.data2 = parts[3].toInt();
             }
 
+            if (valid && !isValidMIDICommand(midiCommand))
+            {
+                *valid = false;
+            }
+
             // Add command to list
             commandList.commands[commandList.count++] = midiCommand;
         }
+        else if (valid)
+        {
+            *valid = false;
+        }
 
         // Move to next command
         commandStart = commandEnd + 1;
@@ -433,36 +1261,16 @@ MIDICommandList parseMIDICommands(String commandString)
     return commandList;
 }
 
-// Writes the command list for a midi button to SPIFFS
-void writeMIDICommands(String filename, MIDICommandList commands)
-{
-    File file = SPIFFS.open(filename, "w");
-    if (!file)
-    {
-        Serial.println("Failed to open file " + filename + " for writing");
-        return;
-    }
-
-    const String commandString = commands.toString();
-    file.print(commandString);
-    file.println();
-    file.close();
-
-#ifdef DEBUG
-    Serial.println("Wrote file " + filename + " with " + String(commands.count) + " commands: " + commandString);
-#endif
-}
-
-// Reads the command list for a midi button from SPIFFS
+// Reads the command list for a midi button from storage
 MIDICommandList readMIDICommands(String filename)
 {
     MIDICommandList commands;
     commands.count = 0;
 
-    File file = SPIFFS.open(filename, "r");
+    File file = storage.open(filename, "r");
     if (!file)
     {
-        Serial.println("Failed to open file " + filename + " for reading");
+        logError("Failed to open file " + filename + " for reading");
         return commands;
     }
 
@@ -479,10 +1287,10 @@ MIDICommandList readMIDICommands(String filename)
 
 void initMIDIButtonVar(MIDIButtonCommands &button, String filename)
 {
-    File file = SPIFFS.open(filename + ".var", "r");
+    File file = storage.open(filename + ".var", "r");
     if (!file)
     {
-        Serial.println("Failed to open file " + filename + ".var for reading");
+        logError("Failed to open file " + filename + ".var for reading");
     }
     else
     {
@@ -494,17 +1302,18 @@ void initMIDIButtonVar(MIDIButtonCommands &button, String filename)
     }
 }
 
-// Initialize a midi button with commands for push, hold and double push from SPIFFS
+// Initialize a midi button with commands for push, hold and double push from the
+// file-per-field layout used before the configuration journal
 void initMIDIButton(MIDIButtonCommands &button, String filename)
 {
     button.push = readMIDICommands(filename + ".push");
     button.hold = readMIDICommands(filename + ".hold");
     button.doublePush = readMIDICommands(filename + ".doublepush");
 
-    File file = SPIFFS.open(filename + ".flags", "r");
+    File file = storage.open(filename + ".flags", "r");
     if (!file)
     {
-        Serial.println("Failed to open file " + filename + ".flags for reading");
+        logError("Failed to open file " + filename + ".flags for reading");
     }
     else
     {
@@ -515,25 +1324,3 @@ void initMIDIButton(MIDIButtonCommands &button, String filename)
 
     initMIDIButtonVar(button, filename);
 }
-
-// Save the command list for a midi button to SPIFFS
-void saveMIDIButton(const MIDIButtonCommands &button, String filename)
-{
-    writeMIDICommands(filename + ".push", button.push);
-    writeMIDICommands(filename + ".hold", button.hold);
-    writeMIDICommands(filename + ".doublepush", button.doublePush);
-
-    File file = SPIFFS.open(filename + ".flags", "w");
-    if (!file)
-    {
-        Serial.println("Failed to open file " + filename + ".flags for writing");
-    }
-    else
-    {
-        file.print(button.flags.toString());
-        file.println();
-        file.close();
-    }
-
-    saveMIDIButtonVar(button, filename);
-}
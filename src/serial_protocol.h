@@ -0,0 +1,197 @@
+#pragma once
+
+// Framed binary protocol on the USB serial port (UART0), to configure and monitor the
+// pedal without Wi-Fi. Every frame, in both directions, is:
+//   0x7E, payload length (2 bytes LE), opcode, payload, CRC-16 of length to payload (2 bytes LE)
+// A frame with a bad CRC or an oversized length is dropped and the reader waits for the
+// next 0x7E. Replies use the opcode of the request with bit 7 set, events are sent
+// unrequested while monitoring is on. tools/pedal_serial.py is the host side.
+
+#ifndef SERIAL_PROTOCOL_BAUD
+#define SERIAL_PROTOCOL_BAUD 115200
+#endif
+// Largest payload received, as the PUT /config body limit
+#ifndef SERIAL_PROTOCOL_MAX_PAYLOAD
+#define SERIAL_PROTOCOL_MAX_PAYLOAD 4096
+#endif
+// An incomplete frame is dropped after this time without bytes
+#ifndef SERIAL_PROTOCOL_TIMEOUT_MS
+#define SERIAL_PROTOCOL_TIMEOUT_MS 500
+#endif
+
+const uint8_t SERIAL_SYNC = 0x7E;
+
+// Requests
+const uint8_t SERIAL_PING = 0x01;       // Reply: protocol version, button count
+const uint8_t SERIAL_GET_CONFIG = 0x02; // Reply: the configuration document (JSON, as GET /config)
+const uint8_t SERIAL_PUT_CONFIG = 0x03; // Payload: a configuration document. Reply: status (2 bytes LE, as PUT /config), message
+const uint8_t SERIAL_TRIGGER = 0x04;    // Payload: button (1-based), gesture (0 push, 1 hold, 2 double push)
+const uint8_t SERIAL_MONITOR = 0x05;    // Payload: 1 to send the events, 0 to stop
+
+const uint8_t SERIAL_REPLY = 0x80;
+
+// Events
+const uint8_t SERIAL_MIDI_EVENT = 0xC0; // Ports, MIDI message
+const uint8_t SERIAL_VAR_EVENT = 0xC1;  // Button (1-based), VAR value (4 bytes LE)
+const uint8_t SERIAL_ERROR = 0xFF;      // Error message
+
+const uint8_t SERIAL_PROTOCOL_VERSION = 1;
+
+// Called for each valid frame received
+void onSerialFrame(uint8_t opcode, const uint8_t *payload, uint16_t length);
+
+// Prints a frame payload to a stream and computes its CRC on the way
+class ChecksumPrint : public Print
+{
+public:
+    ChecksumPrint(Print &out, uint16_t crc) : out(out), crc(crc)
+    {
+    }
+
+    size_t write(uint8_t byte) override
+    {
+        crc = crc16(crc, &byte, 1);
+        return out.write(byte);
+    }
+
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        crc = crc16(crc, buffer, size);
+        return out.write(buffer, size);
+    }
+
+    Print &out;
+    uint16_t crc;
+};
+
+class SerialProtocol
+{
+public:
+    SerialProtocol(Stream &stream) : stream(stream)
+    {
+    }
+
+    // Read the bytes received and dispatch complete frames, call it from loop()
+    void update()
+    {
+        if (state != WAIT_SYNC && millis() - lastByteMs > SERIAL_PROTOCOL_TIMEOUT_MS)
+        {
+            reset();
+        }
+
+        while (stream.available() > 0)
+        {
+            const uint8_t byte = stream.read();
+            lastByteMs = millis();
+            if (state != WAIT_SYNC && state != CRC_LOW && state != CRC_HIGH)
+            {
+                crc = crc16(crc, &byte, 1);
+            }
+
+            switch (state)
+            {
+            case WAIT_SYNC:
+                if (byte == SERIAL_SYNC)
+                {
+                    crc = 0xFFFF;
+                    state = LENGTH_LOW;
+                }
+                break;
+            case LENGTH_LOW:
+                length = byte;
+                state = LENGTH_HIGH;
+                break;
+            case LENGTH_HIGH:
+                length |= byte << 8;
+                state = length <= SERIAL_PROTOCOL_MAX_PAYLOAD ? OPCODE : WAIT_SYNC;
+                break;
+            case OPCODE:
+                opcode = byte;
+                received = 0;
+                if (length > 0)
+                {
+                    payload = (uint8_t *)malloc(length);
+                }
+                state = length == 0 ? CRC_LOW : payload ? PAYLOAD : WAIT_SYNC;
+                break;
+            case PAYLOAD:
+                payload[received++] = byte;
+                if (received == length)
+                {
+                    state = CRC_LOW;
+                }
+                break;
+            case CRC_LOW:
+                storedCrc = byte;
+                state = CRC_HIGH;
+                break;
+            case CRC_HIGH:
+                storedCrc |= byte << 8;
+                if (storedCrc == crc)
+                {
+                    onSerialFrame(opcode, payload, length);
+                }
+                else
+                {
+                    errors++;
+                }
+                reset();
+                break;
+            }
+        }
+    }
+
+    void sendFrame(uint8_t opcode, const uint8_t *payload, uint16_t length)
+    {
+        sendFrame(opcode, [payload, length](Print &out) {
+            out.write(payload, length);
+        });
+    }
+
+    // Send a frame whose payload is printed by print(Print &), called twice: first to size it
+    template <typename PrintFunction>
+    void sendFrame(uint8_t opcode, PrintFunction print)
+    {
+        CountPrint countPrint;
+        print(countPrint);
+        const uint8_t header[4] = {SERIAL_SYNC, (uint8_t)countPrint.length, (uint8_t)(countPrint.length >> 8), opcode};
+        stream.write(header, sizeof(header));
+
+        ChecksumPrint payload(stream, crc16(0xFFFF, header + 1, sizeof(header) - 1));
+        print(payload);
+        const uint8_t trailer[2] = {(uint8_t)payload.crc, (uint8_t)(payload.crc >> 8)};
+        stream.write(trailer, sizeof(trailer));
+    }
+
+    // Frames dropped for a bad CRC
+    uint32_t errors = 0;
+
+private:
+    enum State : uint8_t
+    {
+        WAIT_SYNC,
+        LENGTH_LOW,
+        LENGTH_HIGH,
+        OPCODE,
+        PAYLOAD,
+        CRC_LOW,
+        CRC_HIGH
+    };
+
+    Stream &stream;
+    State state = WAIT_SYNC;
+    uint16_t length = 0;
+    uint16_t received = 0;
+    uint8_t opcode = 0;
+    uint8_t *payload = nullptr;
+    uint16_t crc = 0xFFFF;
+    uint16_t storedCrc = 0;
+    unsigned long lastByteMs = 0;
+
+    void reset()
+    {
+        free(payload);
+        payload = nullptr;
+        state = WAIT_SYNC;
+    }
+};
@@ -0,0 +1,294 @@
+#pragma once
+
+// Storage backend for the configuration, SysEx dumps and web assets.
+// Select one with STORAGE_LITTLEFS or STORAGE_RAM, SPIFFS is used otherwise.
+// The data folder must be uploaded with the same file system (PlatformIO board_build.filesystem).
+// STORAGE_RAM keeps everything in memory and loses it at reboot, it is meant for testing and benchmarks.
+
+#include <FS.h>
+#include <FSImpl.h>
+#include <LittleFS.h>
+#include <map>
+#include <memory>
+
+// In-memory file system, files are heap allocated byte vectors
+class RAMFileImpl : public fs::FileImpl
+{
+public:
+    RAMFileImpl(const std::shared_ptr<std::vector<uint8_t>> &data, const String &path, bool append)
+        : data(data), path(path), append(append)
+    {
+    }
+
+    size_t write(const uint8_t *buf, size_t size) override
+    {
+        if (!data)
+        {
+            return 0;
+        }
+        if (append)
+        {
+            pos = data->size();
+        }
+        if (pos + size > data->size())
+        {
+            data->resize(pos + size);
+        }
+        memcpy(data->data() + pos, buf, size);
+        pos += size;
+        return size;
+    }
+
+    int read(uint8_t *buf, size_t size) override
+    {
+        if (!data || pos >= data->size())
+        {
+            return 0;
+        }
+        size = min(size, data->size() - pos);
+        memcpy(buf, data->data() + pos, size);
+        pos += size;
+        return size;
+    }
+
+    void flush() override {}
+
+    bool seek(uint32_t offset, fs::SeekMode mode) override
+    {
+        if (!data)
+        {
+            return false;
+        }
+        const size_t base = mode == fs::SeekSet ? 0 : mode == fs::SeekCur ? pos : data->size();
+        if (base + offset > data->size())
+        {
+            return false;
+        }
+        pos = base + offset;
+        return true;
+    }
+
+    size_t position() const override
+    {
+        return pos;
+    }
+
+    size_t size() const override
+    {
+        return data ? data->size() : 0;
+    }
+
+    bool truncate(uint32_t size) override
+    {
+        if (!data)
+        {
+            return false;
+        }
+        data->resize(size);
+        pos = min(pos, (size_t)size);
+        return true;
+    }
+
+    void close() override
+    {
+        data.reset();
+    }
+
+    const char *name() const override
+    {
+        const int slash = path.lastIndexOf('/');
+        return path.c_str() + slash + 1;
+    }
+
+    const char *fullName() const override
+    {
+        return path.c_str();
+    }
+
+    bool isFile() const override
+    {
+        return true;
+    }
+
+    bool isDirectory() const override
+    {
+        return false;
+    }
+
+private:
+    std::shared_ptr<std::vector<uint8_t>> data;
+    const String path;
+    const bool append;
+    size_t pos = 0;
+};
+
+typedef std::map<String, std::shared_ptr<std::vector<uint8_t>>> RAMFileMap;
+
+// Flat listing of the files whose path starts with the directory path
+class RAMDirImpl : public fs::DirImpl
+{
+public:
+    RAMDirImpl(const RAMFileMap &files, const String &path) : files(files), path(path)
+    {
+        rewind();
+    }
+
+    fs::FileImplPtr openFile(fs::OpenMode openMode, fs::AccessMode accessMode) override
+    {
+        if (!started || current == files.end())
+        {
+            return fs::FileImplPtr();
+        }
+        return std::make_shared<RAMFileImpl>(current->second, current->first, false);
+    }
+
+    const char *fileName() override
+    {
+        return started && current != files.end() ? current->first.c_str() + path.length() : "";
+    }
+
+    size_t fileSize() override
+    {
+        return started && current != files.end() ? current->second->size() : 0;
+    }
+
+    bool isFile() const override
+    {
+        return started && current != files.end();
+    }
+
+    bool isDirectory() const override
+    {
+        return false;
+    }
+
+    bool next() override
+    {
+        current = started ? std::next(current) : files.begin();
+        started = true;
+        while (current != files.end() && !current->first.startsWith(path))
+        {
+            ++current;
+        }
+        return current != files.end();
+    }
+
+    bool rewind() override
+    {
+        started = false;
+        current = files.end();
+        return true;
+    }
+
+private:
+    const RAMFileMap &files;
+    const String path;
+    RAMFileMap::const_iterator current;
+    bool started = false;
+};
+
+class RAMFSImpl : public fs::FSImpl
+{
+public:
+    bool setConfig(const fs::FSConfig &cfg) override
+    {
+        return true;
+    }
+
+    bool begin() override
+    {
+        return true;
+    }
+
+    void end() override {}
+
+    bool format() override
+    {
+        files.clear();
+        return true;
+    }
+
+    bool info(fs::FSInfo &info) override
+    {
+        return false;
+    }
+
+    bool info64(fs::FSInfo64 &info) override
+    {
+        return false;
+    }
+
+    fs::FileImplPtr open(const char *path, fs::OpenMode openMode, fs::AccessMode accessMode) override
+    {
+        auto file = files.find(path);
+        if (file == files.end())
+        {
+            if (!(openMode & fs::OM_CREATE))
+            {
+                return fs::FileImplPtr();
+            }
+            file = files.emplace(path, std::make_shared<std::vector<uint8_t>>()).first;
+        }
+        if (openMode & fs::OM_TRUNCATE)
+        {
+            file->second->clear();
+        }
+        return std::make_shared<RAMFileImpl>(file->second, file->first, openMode & fs::OM_APPEND);
+    }
+
+    bool exists(const char *path) override
+    {
+        return files.count(path) > 0;
+    }
+
+    fs::DirImplPtr openDir(const char *path) override
+    {
+        return std::make_shared<RAMDirImpl>(files, path);
+    }
+
+    bool rename(const char *pathFrom, const char *pathTo) override
+    {
+        auto file = files.find(pathFrom);
+        if (file == files.end())
+        {
+            return false;
+        }
+        auto data = file->second;
+        files.erase(file);
+        files[pathTo] = data;
+        return true;
+    }
+
+    bool remove(const char *path) override
+    {
+        return files.erase(path) > 0;
+    }
+
+    bool mkdir(const char *path) override
+    {
+        return true;
+    }
+
+    bool rmdir(const char *path) override
+    {
+        return true;
+    }
+
+private:
+    RAMFileMap files;
+};
+
+#if defined(STORAGE_RAM)
+fs::FS RAMFS(std::make_shared<RAMFSImpl>());
+fs::FS &storage = RAMFS;
+#define STORAGE_NAME "RAM"
+#elif defined(STORAGE_LITTLEFS)
+fs::FS &storage = LittleFS;
+#define STORAGE_NAME "LittleFS"
+#else
+fs::FS &storage = SPIFFS;
+#define STORAGE_NAME "SPIFFS"
+#endif
+
+// Folder of the web assets (data/www), the only files the web server sends
+#define WEB_ROOT "/www"
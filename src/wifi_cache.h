@@ -0,0 +1,72 @@
+#pragma once
+
+// Last successful Wi-Fi connection, so the next boot can connect directly to the same
+// access point on its channel instead of scanning all the channels for the known networks.
+// Stored in WIFI_CACHE_PATH as the struct followed by its CRC-16.
+
+#include <ESP8266WiFi.h>
+
+#define WIFI_CACHE_PATH "/wifi"
+
+struct WiFiCache
+{
+    // Index of the network in the known networks (AP_1, AP_2)
+    uint8_t network = 0;
+    uint8_t bssid[6] = {0};
+    int32_t channel = 0;
+    // IP lease, reused with REUSE_IP_LEASE to skip DHCP
+    uint32_t ip = 0;
+    uint32_t gateway = 0;
+    uint32_t subnet = 0;
+    uint32_t dns = 0;
+
+    bool operator==(const WiFiCache &other) const
+    {
+        return network == other.network && memcmp(bssid, other.bssid, sizeof(bssid)) == 0 && channel == other.channel &&
+               ip == other.ip && gateway == other.gateway && subnet == other.subnet && dns == other.dns;
+    }
+};
+
+// Returns false if there is no valid cache
+bool loadWiFiCache(fs::FS &fs, WiFiCache &cache)
+{
+    File file = fs.open(WIFI_CACHE_PATH, "r");
+    if (!file)
+    {
+        return false;
+    }
+    WiFiCache loaded;
+    uint8_t storedCrc[2];
+    const bool complete = file.read((uint8_t *)&loaded, sizeof(loaded)) == sizeof(loaded) && file.read(storedCrc, 2) == 2;
+    file.close();
+
+    const uint16_t crc = crc16(0xFFFF, (const uint8_t *)&loaded, sizeof(loaded));
+    if (!complete || crc != (storedCrc[0] | storedCrc[1] << 8) || loaded.channel < 1 || loaded.channel > 14)
+    {
+        return false;
+    }
+    cache = loaded;
+    return true;
+}
+
+// The file is only written when the connection changed, to spare the flash
+void saveWiFiCache(fs::FS &fs, const WiFiCache &cache)
+{
+    WiFiCache stored;
+    if (loadWiFiCache(fs, stored) && stored == cache)
+    {
+        return;
+    }
+
+    File file = fs.open(WIFI_CACHE_PATH, "w");
+    if (!file)
+    {
+        logError("Failed to open file " WIFI_CACHE_PATH " for writing");
+        return;
+    }
+    const uint16_t crc = crc16(0xFFFF, (const uint8_t *)&cache, sizeof(cache));
+    const uint8_t trailer[2] = {(uint8_t)crc, (uint8_t)(crc >> 8)};
+    file.write((const uint8_t *)&cache, sizeof(cache));
+    file.write(trailer, sizeof(trailer));
+    file.close();
+}
@@ -0,0 +1,50 @@
+// Prints "<configDocumentHash()> <GET /config document>" for a few configurations, for
+// config_hash_test.py to check tools/provision_fleet.py computes the same hashes
+
+#include "midi_controller.h"
+#include "config_document.h"
+
+const uint8_t BUTTONS = 6;
+
+// Defined by main.cpp
+void onMIDIButtonVarChanged(MIDIButtonCommands &button) {}
+
+class StdoutPrint : public Print
+{
+public:
+    size_t write(uint8_t byte) override
+    {
+        return fputc(byte, stdout) == EOF ? 0 : 1;
+    }
+};
+
+void printHashAndDocument(const MIDIButtonCommands *buttons)
+{
+    StdoutPrint out;
+    printf("%08x ", configDocumentHash<BUTTONS>(buttons));
+    printConfigDocument<BUTTONS>(out, buttons);
+    printf("\n");
+}
+
+int main()
+{
+    MIDIButtonCommands buttons[BUTTONS];
+    printHashAndDocument(buttons);
+
+    buttons[0].push = parseMIDICommands("CC 1 80 127,CC 1 80 0");
+    buttons[0].hold = parseMIDICommands("CC 1 81 127 @12,CC 1 81 0");
+    buttons[4].push = parseMIDICommands("VAR_INC 1 1 0,CC 1 85 VAR,CC 1 85 127");
+    buttons[4].doublePush = parseMIDICommands("VAR_DEC 1 1 0,CC 1 85 VAR,CC 1 85 127");
+    buttons[4].flags.repeatOnHold = true;
+    buttons[4].var.min = 0;
+    buttons[4].var.max = 56;
+    buttons[4].var.value = 23;
+    buttons[5].var.min = -10;
+    buttons[5].var.step = 3;
+    printHashAndDocument(buttons);
+
+    // Same configuration, played: the hash doesn't change
+    buttons[4].var.value = 42;
+    printHashAndDocument(buttons);
+    return 0;
+}
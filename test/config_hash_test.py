@@ -0,0 +1,30 @@
+#!/usr/bin/env python3
+"""Check that tools/provision_fleet.py hashes a GET /config document like the pedal.
+
+Reads the "<hash> <document>" lines printed by config_hash_test.
+"""
+
+import json
+import os
+import sys
+
+sys.dont_write_bytecode = True
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), "..", "tools"))
+from provision_fleet import fnv1a, render  # noqa: E402
+
+failures = 0
+hashes = []
+for line in sys.stdin:
+    expected, document = line.rstrip("\n").split(" ", 1)
+    actual = fnv1a(render(json.loads(document)))
+    hashes.append(actual)
+    if actual != expected:
+        print("FAIL: pedal %s, provision_fleet.py %s for %s" % (expected, actual, document))
+        failures += 1
+
+if len(hashes) < 3 or hashes[1] != hashes[2]:
+    print("FAIL: the VAR values change the hash")
+    failures += 1
+
+print("%d failures" % failures if failures else "OK")
+sys.exit(1 if failures else 0)
@@ -0,0 +1,238 @@
+#pragma once
+
+// Simulated NOR flash under a file system, to count what a storage scheme costs the chip.
+// The files are kept by a RAMFSImpl, the flash is only accounted for:
+// - data is programmed in whole FLASH_PAGE_SIZE pages when a file is closed, appending to a
+//   partly filled page rewrites it to a new page and the old one becomes obsolete
+// - truncating or removing a file makes all its pages obsolete
+// - creating, resizing, renaming or removing a file programs a metadata page, which makes
+//   the previous metadata page obsolete
+// - obsolete pages are reclaimed by erasing blocks: one erase per FLASH_BLOCK_SIZE of them
+// This is the page and block accounting of SPIFFS, ignoring the live pages moved by its
+// garbage collection, so the erase counts are lower bounds.
+
+#include "storage.h"
+
+#include <string>
+
+const size_t FLASH_PAGE_SIZE = 256;
+const size_t FLASH_BLOCK_SIZE = 4096;
+
+struct FlashStats
+{
+    // Bytes written by the application, and programmed on the flash
+    uint64_t bytesWritten = 0;
+    uint64_t bytesProgrammed = 0;
+    uint32_t erases = 0;
+    uint32_t obsoletePages = 0;
+};
+
+class FlashFSImpl : public fs::FSImpl
+{
+public:
+    bool setConfig(const fs::FSConfig &cfg) override
+    {
+        return true;
+    }
+
+    bool begin() override
+    {
+        return true;
+    }
+
+    void end() override {}
+
+    bool format() override
+    {
+        programmed.clear();
+        return ram.format();
+    }
+
+    bool info(fs::FSInfo &info) override
+    {
+        return false;
+    }
+
+    bool info64(fs::FSInfo64 &info) override
+    {
+        return false;
+    }
+
+    fs::FileImplPtr open(const char *path, fs::OpenMode openMode, fs::AccessMode accessMode) override;
+
+    bool exists(const char *path) override
+    {
+        return ram.exists(path);
+    }
+
+    fs::DirImplPtr openDir(const char *path) override
+    {
+        return ram.openDir(path);
+    }
+
+    bool rename(const char *pathFrom, const char *pathTo) override
+    {
+        if (!ram.rename(pathFrom, pathTo))
+        {
+            return false;
+        }
+        obsolete(pages(programmed[pathTo]));
+        programmed[pathTo] = programmed[pathFrom];
+        programmed.erase(pathFrom);
+        metadata();
+        return true;
+    }
+
+    bool remove(const char *path) override
+    {
+        if (!ram.remove(path))
+        {
+            return false;
+        }
+        obsolete(pages(programmed[path]));
+        programmed.erase(path);
+        metadata();
+        return true;
+    }
+
+    bool mkdir(const char *path) override
+    {
+        return true;
+    }
+
+    bool rmdir(const char *path) override
+    {
+        return true;
+    }
+
+    // Program the bytes of the file not programmed yet
+    void program(const std::string &path, size_t size)
+    {
+        size_t &done = programmed[path];
+        if (size == done)
+        {
+            return;
+        }
+        const size_t firstPage = done / FLASH_PAGE_SIZE;
+        if (done % FLASH_PAGE_SIZE)
+        {
+            obsolete(1);
+        }
+        stats.bytesProgrammed += (pages(size) - firstPage) * FLASH_PAGE_SIZE;
+        done = size;
+        metadata();
+    }
+
+    FlashStats stats;
+
+private:
+    RAMFSImpl ram;
+    // Bytes of each file programmed on the flash
+    std::map<std::string, size_t> programmed;
+
+    static size_t pages(size_t bytes)
+    {
+        return (bytes + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE;
+    }
+
+    void obsolete(size_t count)
+    {
+        stats.obsoletePages += count;
+        while (stats.obsoletePages >= FLASH_BLOCK_SIZE / FLASH_PAGE_SIZE)
+        {
+            stats.obsoletePages -= FLASH_BLOCK_SIZE / FLASH_PAGE_SIZE;
+            stats.erases++;
+        }
+    }
+
+    void metadata()
+    {
+        stats.bytesProgrammed += FLASH_PAGE_SIZE;
+        obsolete(1);
+    }
+
+    friend class FlashFileImpl;
+};
+
+class FlashFileImpl : public fs::FileImpl
+{
+public:
+    FlashFileImpl(FlashFSImpl &fs, const fs::FileImplPtr &file, const char *path) : fs(fs), file(file), path(path) {}
+
+    size_t write(const uint8_t *buf, size_t size) override
+    {
+        fs.stats.bytesWritten += size;
+        return file->write(buf, size);
+    }
+    int read(uint8_t *buf, size_t size) override
+    {
+        return file->read(buf, size);
+    }
+    void flush() override
+    {
+        fs.program(path, file->size());
+    }
+    bool seek(uint32_t pos, fs::SeekMode mode) override
+    {
+        return file->seek(pos, mode);
+    }
+    size_t position() const override
+    {
+        return file->position();
+    }
+    size_t size() const override
+    {
+        return file->size();
+    }
+    bool truncate(uint32_t size) override
+    {
+        return file->truncate(size);
+    }
+    void close() override
+    {
+        fs.program(path, file->size());
+        file->close();
+    }
+    const char *name() const override
+    {
+        return file->name();
+    }
+    const char *fullName() const override
+    {
+        return file->fullName();
+    }
+    bool isFile() const override
+    {
+        return true;
+    }
+    bool isDirectory() const override
+    {
+        return false;
+    }
+
+private:
+    FlashFSImpl &fs;
+    fs::FileImplPtr file;
+    const std::string path;
+};
+
+inline fs::FileImplPtr FlashFSImpl::open(const char *path, fs::OpenMode openMode, fs::AccessMode accessMode)
+{
+    const bool existed = ram.exists(path);
+    fs::FileImplPtr file = ram.open(path, openMode, accessMode);
+    if (!file)
+    {
+        return file;
+    }
+    if (!existed)
+    {
+        metadata();
+    }
+    else if ((openMode & fs::OM_TRUNCATE) && programmed[path] > 0)
+    {
+        obsolete(pages(programmed[path]));
+        programmed[path] = 0;
+        metadata();
+    }
+    return std::make_shared<FlashFileImpl>(*this, file, path);
+}
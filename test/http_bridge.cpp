@@ -0,0 +1,133 @@
+// Runs main.cpp on the host shim with its web server on a TCP port of 127.0.0.1, so
+// tools/provision_fleet.py talks to the real request handlers (see
+// provision_fleet_test.py). GET /mdns stands in for the mDNS service: it answers the host
+// name and the "config" TXT item published by the pedal, one per line. Prints the port,
+// then runs loop() until it is killed. The virtual clock moves LOOP_US per pass.
+
+#include "main.cpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+const uint64_t LOOP_US = 200;
+
+// Reads one request and answers it, HTTP/1.1 with the connection closed after the response
+void serveConnection(int client)
+{
+    std::string data;
+    size_t headerEnd = std::string::npos;
+    size_t contentLength = 0;
+    for (;;)
+    {
+        if (headerEnd == std::string::npos && (headerEnd = data.find("\r\n\r\n")) != std::string::npos)
+        {
+            const size_t length = data.find("\nContent-Length:");
+            contentLength = length < headerEnd ? strtoul(data.c_str() + length + 16, nullptr, 10) : 0;
+        }
+        if (headerEnd != std::string::npos && data.size() >= headerEnd + 4 + contentLength)
+        {
+            break;
+        }
+        char bytes[1024];
+        const ssize_t count = read(client, bytes, sizeof(bytes));
+        if (count <= 0)
+        {
+            return;
+        }
+        data.append(bytes, count);
+    }
+
+    // Request line and headers
+    std::map<std::string, String> headers;
+    const size_t lineEnd = data.find("\r\n");
+    const std::string requestLine = data.substr(0, lineEnd);
+    for (size_t line = lineEnd + 2; line < headerEnd;)
+    {
+        const size_t next = data.find("\r\n", line);
+        const size_t colon = data.find(':', line);
+        if (colon < next)
+        {
+            const size_t value = data.find_first_not_of(' ', colon + 1);
+            headers[data.substr(line, colon - line)] = String(data.substr(value, next - value).c_str());
+        }
+        line = next + 2;
+    }
+    const std::string method = requestLine.substr(0, requestLine.find(' '));
+    const size_t urlStart = method.size() + 1;
+    const String url = requestLine.substr(urlStart, requestLine.find(' ', urlStart) - urlStart).c_str();
+    const String body = data.substr(headerEnd + 4, contentLength).c_str();
+
+    AsyncWebServerResponse response(0);
+    if (url == "/mdns")
+    {
+        response = AsyncWebServerResponse(200, MDNS.hostname + "\n" + MDNS.txt("config") + "\n");
+    }
+    else
+    {
+        response = server.request(method == "GET" ? HTTP_GET : method == "PUT" ? HTTP_PUT : HTTP_POST, url, body, headers);
+    }
+
+    std::string reply = "HTTP/1.1 " + std::to_string(response.code ? response.code : 500) + " -\r\n";
+    for (const auto &header : response.headers)
+    {
+        reply += header.first + ": " + header.second.c_str() + "\r\n";
+    }
+    reply += "Content-Length: " + std::to_string(response.content.length()) + "\r\nConnection: close\r\n\r\n";
+    // No body for 204 and 304
+    if (response.code != 204 && response.code != 304)
+    {
+        reply += response.content.c_str();
+    }
+    for (size_t sent = 0; sent < reply.size();)
+    {
+        const ssize_t count = write(client, reply.data() + sent, reply.size() - sent);
+        if (count <= 0)
+        {
+            return;
+        }
+        sent += count;
+    }
+}
+
+int main()
+{
+    const int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (listener < 0 || bind(listener, (sockaddr *)&address, sizeof(address)) != 0 || listen(listener, 8) != 0 ||
+        getsockname(listener, (sockaddr *)&address, &length) != 0)
+    {
+        perror("socket");
+        return 1;
+    }
+
+    // An access point in range, for the web server to start
+    sim::accessPoint.ssid = AP_2;
+    sim::accessPoint.password = PWD_2;
+    sim::accessPoint.channel = 6;
+
+    setup();
+    printf("%d\n", ntohs(address.sin_port));
+    fflush(stdout);
+    for (;;)
+    {
+        pollfd input = {listener, POLLIN, 0};
+        if (poll(&input, 1, 1) > 0 && (input.revents & POLLIN))
+        {
+            const int client = accept(listener, nullptr, nullptr);
+            if (client >= 0)
+            {
+                serveConnection(client);
+                close(client);
+            }
+        }
+
+        loop();
+        sim::advanceUs(LOOP_US);
+    }
+}
@@ -0,0 +1,142 @@
+// Write amplification and erase count of the configuration journal against the file per
+// field scheme it replaced (saveMIDIButton() and saveMIDIButtonVar()), on the simulated
+// flash of flash_device.h. Two workloads: saving the whole configuration from the web page,
+// and VAR changes, one per push of a PATTERN INC button.
+
+#include "midi_controller.h"
+#include "config_journal.h"
+#include "flash_device.h"
+
+const uint8_t BUTTONS = 6;
+const uint32_t CONFIG_SAVES = 100;
+const uint32_t VAR_CHANGES = 1000;
+
+MIDIButtonCommands buttons[BUTTONS];
+
+// Defined by main.cpp
+void onMIDIButtonVarChanged(MIDIButtonCommands &button) {}
+
+// File per field scheme: <filename>.push, .hold, .doublepush, .flags and .var, rewritten on each save
+void writeMIDICommands(fs::FS &fs, const String &filename, const MIDICommandList &commands)
+{
+    File file = fs.open(filename, "w");
+    commands.printTo(file);
+    file.println();
+    file.close();
+}
+
+void saveMIDIButtonVar(fs::FS &fs, const MIDIButtonCommands &button, const String &filename)
+{
+    File file = fs.open(filename + ".var", "w");
+    file.print(button.var.value);
+    file.println();
+    file.print(button.var.min);
+    file.println();
+    file.print(button.var.max);
+    file.println();
+    file.print(button.var.step);
+    file.println();
+    file.close();
+}
+
+void saveMIDIButton(fs::FS &fs, const MIDIButtonCommands &button, const String &filename)
+{
+    writeMIDICommands(fs, filename + ".push", button.push);
+    writeMIDICommands(fs, filename + ".hold", button.hold);
+    writeMIDICommands(fs, filename + ".doublepush", button.doublePush);
+
+    File file = fs.open(filename + ".flags", "w");
+    file.print(button.flags.toString());
+    file.println();
+    file.close();
+
+    saveMIDIButtonVar(fs, button, filename);
+}
+
+void print(const char *scheme, const char *workload, uint32_t operations, const FlashStats &stats)
+{
+    printf("%-14s %-12s %7.1f bytes written, %7.1f bytes programmed, write amplification %5.1f, %6.3f erases per operation\n",
+           scheme, workload, (double)stats.bytesWritten / operations, (double)stats.bytesProgrammed / operations,
+           (double)stats.bytesProgrammed / stats.bytesWritten, (double)stats.erases / operations);
+}
+
+void benchmarkFilePerField()
+{
+    auto flash = std::make_shared<FlashFSImpl>();
+    fs::FS fs(flash);
+    for (uint32_t i = 0; i < CONFIG_SAVES; i++)
+    {
+        for (uint8_t j = 0; j < BUTTONS; j++)
+        {
+            saveMIDIButton(fs, buttons[j], "/button" + String(j + 1));
+        }
+    }
+    print("file per field", "config save", CONFIG_SAVES, flash->stats);
+
+    flash->stats = FlashStats();
+    for (uint32_t i = 0; i < VAR_CHANGES; i++)
+    {
+        buttons[4].var.value = i % 57;
+        saveMIDIButtonVar(fs, buttons[4], "/button5");
+    }
+    print("file per field", "VAR change", VAR_CHANGES, flash->stats);
+}
+
+// Compactions run from loop(), between the saves
+void compact(ConfigJournal<BUTTONS> &journal)
+{
+    while (journal.isCompacting())
+    {
+        journal.update();
+    }
+}
+
+void benchmarkJournal()
+{
+    auto flash = std::make_shared<FlashFSImpl>();
+    fs::FS fs(flash);
+    ConfigJournal<BUTTONS> journal(buttons, fs);
+    for (uint32_t i = 0; i < CONFIG_SAVES; i++)
+    {
+        for (uint8_t j = 0; j < BUTTONS; j++)
+        {
+            journal.saveButton(j, j == BUTTONS - 1);
+        }
+        compact(journal);
+    }
+    print("journal", "config save", CONFIG_SAVES, flash->stats);
+    const uint32_t compactions = journal.compactions;
+
+    flash->stats = FlashStats();
+    for (uint32_t i = 0; i < VAR_CHANGES; i++)
+    {
+        buttons[4].var.value = i % 57;
+        journal.saveVar(4);
+        compact(journal);
+    }
+    print("journal", "VAR change", VAR_CHANGES, flash->stats);
+    printf("journal compactions: %u for the config saves, %u for the VAR changes\n", compactions, journal.compactions - compactions);
+}
+
+int main()
+{
+    // The default configuration of main.cpp
+    buttons[0].push = parseMIDICommands("CC 1 80 127,CC 1 80 0");
+    buttons[0].hold = parseMIDICommands("CC 1 81 127,CC 1 81 0");
+    buttons[1].push = parseMIDICommands("CC 1 82 127,CC 1 82 0");
+    buttons[1].hold = parseMIDICommands("CC 1 82 127,CC 1 82 0");
+    buttons[2].push = parseMIDICommands("CC 1 83 127,CC 1 83 0");
+    buttons[3].push = parseMIDICommands("CC 1 84 127,CC 1 84 0");
+    buttons[4].push = parseMIDICommands("VAR_INC 1 1 0,CC 1 85 VAR,CC 1 85 127");
+    buttons[4].hold = buttons[4].push;
+    buttons[4].doublePush = parseMIDICommands("VAR_DEC 1 1 0,CC 1 85 VAR,CC 1 85 127");
+    buttons[4].flags.repeatOnHold = true;
+    buttons[4].var.max = 56;
+    buttons[5].push = parseMIDICommands("CC 1 86 127,CC 1 86 0");
+    buttons[5].hold = parseMIDICommands("CC 1 87 127,CC 1 87 0");
+    buttons[5].flags.repeatOnHold = true;
+
+    benchmarkFilePerField();
+    benchmarkJournal();
+    return 0;
+}
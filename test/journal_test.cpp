@@ -0,0 +1,183 @@
+// Boot after a power cut in the middle of a compaction: the snapshot in /journal.tmp only
+// replaces a missing journal when it is complete. A torn record at the end of the journal
+// is cut at boot, and a large configuration isn't rewritten on every change.
+
+#include "midi_controller.h"
+#include "config_journal.h"
+#include "storage.h"
+
+const uint8_t BUTTONS = 6;
+
+int failures = 0;
+
+#define CHECK(condition, message)                                                                                                \
+    do                                                                                                                           \
+    {                                                                                                                            \
+        if (!(condition))                                                                                                        \
+        {                                                                                                                        \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, message);                                                             \
+            failures++;                                                                                                          \
+        }                                                                                                                        \
+    } while (0)
+
+// Defined by main.cpp
+void onMIDIButtonVarChanged(MIDIButtonCommands &button) {}
+
+MIDIButtonCommands saved[BUTTONS];
+
+// A journal holding the configuration, and a compaction stopped after writing steps buttons of
+// the snapshot, with the old journal removed or not
+void powerCutDuringCompaction(fs::FS &fs, uint8_t steps, bool journalRemoved)
+{
+    ConfigJournal<BUTTONS> journal(saved, fs);
+    for (uint8_t i = 0; i < BUTTONS; i++)
+    {
+        journal.saveButton(i, i == BUTTONS - 1);
+    }
+    journal.compact();
+    for (uint8_t i = 0; i < steps; i++)
+    {
+        journal.update();
+    }
+    if (journalRemoved)
+    {
+        fs.remove(JOURNAL_PATH ".log");
+    }
+}
+
+bool sameConfiguration(const MIDIButtonCommands *buttons)
+{
+    for (uint8_t i = 0; i < BUTTONS; i++)
+    {
+        if (buttons[i].push.toString() != saved[i].push.toString() || buttons[i].var.value != saved[i].var.value)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void testCompleteSnapshot()
+{
+    printf("complete snapshot\n");
+    fs::FS fs(std::make_shared<RAMFSImpl>());
+    powerCutDuringCompaction(fs, BUTTONS, true);
+
+    MIDIButtonCommands loaded[BUTTONS];
+    CHECK(ConfigJournal<BUTTONS>(loaded, fs).load(), "snapshot promoted");
+    CHECK(fs.exists(JOURNAL_PATH ".log") && !fs.exists(JOURNAL_PATH ".tmp"), "snapshot renamed to the journal");
+    CHECK(sameConfiguration(loaded), "configuration replayed from the snapshot");
+}
+
+void testPartialSnapshot()
+{
+    printf("partial snapshot\n");
+    fs::FS fs(std::make_shared<RAMFSImpl>());
+    powerCutDuringCompaction(fs, BUTTONS - 1, true);
+
+    MIDIButtonCommands loaded[BUTTONS];
+    CHECK(!ConfigJournal<BUTTONS>(loaded, fs).load(), "partial snapshot not promoted");
+    CHECK(!fs.exists(JOURNAL_PATH ".log") && !fs.exists(JOURNAL_PATH ".tmp"), "partial snapshot removed");
+    CHECK(loaded[0].push.count == 0, "nothing replayed from the partial snapshot");
+}
+
+void testJournalKept()
+{
+    printf("journal kept\n");
+    fs::FS fs(std::make_shared<RAMFSImpl>());
+    powerCutDuringCompaction(fs, BUTTONS - 1, false);
+
+    MIDIButtonCommands loaded[BUTTONS];
+    CHECK(ConfigJournal<BUTTONS>(loaded, fs).load(), "journal loaded");
+    CHECK(!fs.exists(JOURNAL_PATH ".tmp"), "snapshot removed");
+    CHECK(sameConfiguration(loaded), "configuration replayed from the journal");
+}
+
+// Power cut in the middle of a VAR record: the next VAR change must survive another power
+// cut, before any compaction has run
+void testTornTail()
+{
+    printf("torn tail\n");
+    fs::FS fs(std::make_shared<RAMFSImpl>());
+    powerCutDuringCompaction(fs, 0, false);
+    File file = fs.open(JOURNAL_PATH ".log", "a");
+    const uint8_t torn[] = {JOURNAL_MAGIC, JOURNAL_VAR | JOURNAL_COMMIT, 4, 16, 0, 1, 2};
+    file.write(torn, sizeof(torn));
+    file.close();
+
+    MIDIButtonCommands loaded[BUTTONS];
+    ConfigJournal<BUTTONS> journal(loaded, fs);
+    CHECK(journal.load(), "journal loaded");
+    loaded[4].var.value = 42;
+    journal.saveVar(4);
+
+    MIDIButtonCommands reloaded[BUTTONS];
+    CHECK(ConfigJournal<BUTTONS>(reloaded, fs).load(), "journal loaded after the power cut");
+    CHECK(reloaded[4].var.value == 42, "VAR change appended after the torn record replayed");
+    CHECK(reloaded[0].push.toString() == saved[0].push.toString(), "configuration replayed");
+}
+
+// A snapshot over JOURNAL_COMPACT_SIZE: 6 buttons with 3 lists of 20 commands
+void testLargeSnapshot()
+{
+    printf("large snapshot\n");
+    fs::FS fs(std::make_shared<RAMFSImpl>());
+    MIDIButtonCommands buttons[BUTTONS];
+    String commands;
+    for (uint8_t i = 0; i < 20; i++)
+    {
+        commands += String(i ? "," : "") + "CC 16 " + String(100 + i) + " 127";
+    }
+    for (uint8_t i = 0; i < BUTTONS; i++)
+    {
+        buttons[i].push = parseMIDICommands(commands);
+        buttons[i].hold = buttons[i].push;
+        buttons[i].doublePush = buttons[i].push;
+    }
+
+    ConfigJournal<BUTTONS> journal(buttons, fs);
+    for (uint8_t i = 0; i < BUTTONS; i++)
+    {
+        journal.saveButton(i, i == BUTTONS - 1);
+    }
+    journal.compact();
+    while (journal.isCompacting())
+    {
+        journal.update();
+    }
+    File file = fs.open(JOURNAL_PATH ".log", "r");
+    CHECK(file.size() > JOURNAL_COMPACT_SIZE, "snapshot larger than JOURNAL_COMPACT_SIZE");
+    file.close();
+
+    const uint32_t compactions = journal.compactions;
+    const uint32_t bytesWritten = journal.bytesWritten;
+    for (uint8_t i = 0; i < 10; i++)
+    {
+        buttons[4].var.value = i;
+        journal.saveVar(4);
+        while (journal.isCompacting())
+        {
+            journal.update();
+        }
+    }
+    printf("  10 VAR changes: %u bytes written, %u compactions\n", journal.bytesWritten - bytesWritten, journal.compactions - compactions);
+    CHECK(journal.compactions == compactions, "no compaction for a few VAR changes");
+}
+
+int main()
+{
+    for (uint8_t i = 0; i < BUTTONS; i++)
+    {
+        saved[i].push = parseMIDICommands("CC 1 " + String(80 + i) + " 127,CC 1 " + String(80 + i) + " 0");
+        saved[i].var.value = i;
+    }
+
+    testCompleteSnapshot();
+    testPartialSnapshot();
+    testJournalKept();
+    testTornTail();
+    testLargeSnapshot();
+
+    printf(failures ? "%d failures\n" : "OK\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+// The serializer of the command lists before it wrote to a Print (14710db), the reference
+// for the saved and served format. The "@<ports>" suffix came after it and is appended the
+// way printTo() defines it.
+
+String oldMIDICommandToString(const MIDICommand &midiCommand)
+{
+    const uint8_t command = midiCommand.command;
+    String commandString = command == NOTE_OFF ? "NOTE_OFF" : command == NOTE_ON        ? "NOTE_ON"
+                                                          : command == KEY_PRESSURE     ? "KEY_PRESSURE"
+                                                          : command == CC               ? "CC"
+                                                          : command == PROGRAM_CHANGE   ? "PC"
+                                                          : command == CHANNEL_PRESSURE ? "CHANNEL_PRESSURE"
+                                                          : command == PITCH_BEND       ? "PITCH_BEND"
+                                                          : command == VAR_INC          ? "VAR_INC"
+                                                          : command == VAR_DEC          ? "VAR_DEC"
+                                                          : command == NRPN             ? "NRPN"
+                                                          : command == RPN              ? "RPN"
+                                                          : command == CC14             ? "CC14"
+                                                          : command == PITCH_BEND14     ? "PITCH_BEND14"
+                                                          : command == SYSEX            ? "SYSEX"
+                                                                                        : "UNKNOWN";
+
+    if (commandString == "UNKNOWN")
+    {
+        return "";
+    }
+
+    commandString += " ";
+    commandString += String(midiCommand.channel);
+    commandString += " ";
+    commandString += midiCommand.data1 < 0 ? "VAR" : String(midiCommand.data1);
+    commandString += " ";
+    commandString += midiCommand.data2 < 0 ? "VAR" : String(midiCommand.data2);
+    if (midiCommand.ports != 0)
+    {
+        commandString += " @";
+        for (uint8_t i = 0; i < MIDI_PORT_COUNT; i++)
+        {
+            if (midiCommand.ports & (1 << i))
+            {
+                commandString += (char)('1' + i);
+            }
+        }
+    }
+    return commandString;
+}
+
+String oldMIDICommandListToString(const MIDICommandList &commandList)
+{
+    String commandString = "";
+    for (int i = 0; i < commandList.count; i++)
+    {
+        const String currentCommandString = oldMIDICommandToString(commandList.commands[i]);
+        if (currentCommandString == "")
+        {
+            continue;
+        }
+        if (i > 0)
+        {
+            commandString += ",";
+        }
+        commandString += currentCommandString;
+    }
+    return commandString;
+}
+
+// Deterministic command lists covering every status byte, VAR data, the data ranges and the ports
+struct CommandListGenerator
+{
+    uint32_t state = 1;
+
+    uint32_t next()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    MIDICommandList list()
+    {
+        static const int DATA[] = {MIDI_VAR, 0, 1, 9, 10, 99, 100, 127, 128, 999, 1000, 9999, 16383};
+        MIDICommandList commandList;
+        commandList.count = next() % 33;
+        for (uint8_t i = 0; i < commandList.count; i++)
+        {
+            MIDICommand &command = commandList.commands[i];
+            // Known commands most of the time, any status byte otherwise
+            static const uint8_t KNOWN[] = {NOTE_OFF, NOTE_ON, KEY_PRESSURE, CC, PROGRAM_CHANGE, CHANNEL_PRESSURE, PITCH_BEND,
+                                            VAR_INC, VAR_DEC, NRPN, RPN, CC14, PITCH_BEND14, SYSEX};
+            command.command = next() % 4 ? KNOWN[next() % sizeof(KNOWN)] : next() % 256;
+            command.channel = next() % 17;
+            command.data1 = DATA[next() % (sizeof(DATA) / sizeof(DATA[0]))];
+            command.data2 = DATA[next() % (sizeof(DATA) / sizeof(DATA[0]))];
+            command.ports = next() % 3 ? 0 : next() % (1 << MIDI_PORT_COUNT);
+        }
+        return commandList;
+    }
+};
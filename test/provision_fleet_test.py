@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""Run tools/provision_fleet.py against two pedals on the host shim.
+
+Each http_bridge (main.cpp on the host shim, its web server on a local port) is a pedal.
+A zeroconf module put in sys.modules stands in for the mDNS discovery: it lists the
+bridges as midi-pedal-* services, with the "config" TXT item the firmware publishes
+(GET /mdns on the bridge). Checked: a pedal with the configuration is skipped and the
+other one updated, a pedal changed between discovery and PUT answers 412 and keeps its
+change, and --host reads the hash from the ETag before the conditional PUT.
+"""
+
+import json
+import os
+import subprocess
+import sys
+import types
+import urllib.request
+
+sys.dont_write_bytecode = True
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.join(HERE, "..", "tools"))
+
+import provision_fleet  # noqa: E402
+
+failures = 0
+bridges = {}
+
+
+def check(condition, message):
+    global failures
+    if not condition:
+        print("FAIL: %s" % message)
+        failures += 1
+
+
+def get(host, path):
+    with urllib.request.urlopen("http://%s%s" % (host, path), timeout=10) as response:
+        return response.read().decode()
+
+
+def put(host, document):
+    request = urllib.request.Request("http://%s/config" % host, data=json.dumps(document).encode(), method="PUT")
+    with urllib.request.urlopen(request, timeout=10) as response:
+        return response.status
+
+
+class ServiceInfo:
+    def __init__(self, host):
+        config = get(host, "/mdns").split("\n")[1]
+        self.server = "127.0.0.1."
+        self.port = int(host.split(":")[1])
+        self.properties = {b"config": config.encode()}
+
+
+class Zeroconf:
+    def get_service_info(self, type_, name):
+        return ServiceInfo(bridges[name])
+
+    def close(self):
+        pass
+
+
+class ServiceBrowser:
+    def __init__(self, zeroconf, type_, listener):
+        listener.add_service(zeroconf, type_, "printer._http._tcp.local.")
+        for name in sorted(bridges):
+            listener.add_service(zeroconf, type_, name)
+
+
+zeroconf = types.ModuleType("zeroconf")
+zeroconf.Zeroconf = Zeroconf
+zeroconf.ServiceBrowser = ServiceBrowser
+sys.modules["zeroconf"] = zeroconf
+
+
+def start_bridge(name):
+    process = subprocess.Popen([os.path.join(HERE, "build", "http_bridge")], stdout=subprocess.PIPE, text=True)
+    bridges[name] = "127.0.0.1:%s" % process.stdout.readline().strip()
+    return process
+
+
+processes = [start_bridge("midi-pedal-a._http._tcp.local."), start_bridge("midi-pedal-b._http._tcp.local.")]
+try:
+    first, second = bridges["midi-pedal-a._http._tcp.local."], bridges["midi-pedal-b._http._tcp.local."]
+    target = json.loads(get(first, "/config"))
+    target["buttons"][2]["push"] = "PC 1 5 0"
+    body = json.dumps(target).encode()
+    expected = provision_fleet.fnv1a(provision_fleet.render(target))
+
+    print("discovery")
+    check(put(second, target) == 204, "second pedal configured beforehand")
+    pedals = provision_fleet.discover(0)
+    check(sorted(pedals) == sorted(bridges.values()), "both pedals found, with their port: %s" % pedals)
+    check(pedals.get(second) == expected, "hash of the configured pedal from its TXT record")
+    check(pedals.get(first) not in ("", expected), "hash of the other pedal from its TXT record")
+
+    print("update")
+    check(provision_fleet.provision(pedals, body) == 0, "provisioned without failure")
+    check(json.loads(get(first, "/config"))["buttons"][2]["push"] == "PC 1 5 0", "first pedal updated")
+    check(provision_fleet.provision(provision_fleet.discover(0), body) == 0, "second run")
+
+    print("changed since discovery")
+    pedals = provision_fleet.discover(0)
+    other = json.loads(get(first, "/config"))
+    other["buttons"][2]["push"] = "PC 1 6 0"
+    check(put(first, other) == 204, "first pedal changed by another client")
+    target["buttons"][2]["push"] = "PC 1 7 0"
+    body = json.dumps(target).encode()
+    check(provision_fleet.provision(pedals, body) == 1, "the changed pedal is a failure")
+    check(json.loads(get(first, "/config"))["buttons"][2]["push"] == "PC 1 6 0", "change of the other client kept")
+    check(json.loads(get(second, "/config"))["buttons"][2]["push"] == "PC 1 7 0", "unchanged pedal updated")
+
+    print("--host")
+    check(provision_fleet.provision({first: ""}, body) == 0, "hash read from the ETag")
+    check(json.loads(get(first, "/config"))["buttons"][2]["push"] == "PC 1 7 0", "first pedal updated")
+finally:
+    for process in processes:
+        process.kill()
+        process.wait()
+
+print("%d failures" % failures if failures else "OK")
+sys.exit(1 if failures else 0)
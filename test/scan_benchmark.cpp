@@ -0,0 +1,62 @@
+// Footswitch scan time against the button count: one ShiftRegisterButtonInput::scan() and
+// N OneButton::tick() per loop() pass, up to 32 buttons (4 chained 74HC165).
+//
+// The SPI burst is timed on the virtual clock of the shim, 8 clocks per register at
+// SHIFT_REGISTER_SPI_FREQUENCY, like on the pedal. The CPU time is measured on the host:
+// it only shows how it grows with the button count, the ESP8266 is much slower.
+
+#include "midi_controller.h"
+#include "button_input.h"
+
+#include <chrono>
+
+// A scan must stay under the millis() resolution OneButton times the gestures with
+const uint64_t SCAN_BUDGET_US = 1000;
+const uint32_t SCANS = 200000;
+
+bool overBudget = false;
+
+// Defined by main.cpp
+void onMIDIButtonVarChanged(MIDIButtonCommands &button) {}
+
+template <uint8_t N>
+void benchmark()
+{
+    ButtonScanner<N, ShiftRegisterButtonInput> footswitches(SHIFT_REGISTER_LOAD_PIN);
+    footswitches.begin();
+
+    uint64_t busUs = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < SCANS; i++)
+    {
+        // Every 64 scans, press or release the buttons of one register so the state machines run
+        if (i % 64 == 0)
+        {
+            sim::shiftRegister[(i / 64) % ((N + 7) / 8)] ^= 0xFF;
+        }
+        const uint64_t scanStart = sim::nowUs();
+        footswitches.tick();
+        busUs += sim::nowUs() - scanStart;
+        // The rest of the loop() pass
+        sim::advanceUs(100);
+    }
+    const double hostNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / SCANS;
+    const double scanUs = (double)busUs / SCANS;
+
+    printf("%2u buttons: SPI burst %5.1f us, scan and debounce %6.1f ns of host CPU (%4.1f ns per button)\n", N, scanUs, hostNs, hostNs / N);
+    if (scanUs > SCAN_BUDGET_US)
+    {
+        printf("  over the %llu us budget\n", (unsigned long long)SCAN_BUDGET_US);
+        overBudget = true;
+    }
+    std::fill(sim::shiftRegister, sim::shiftRegister + sizeof(sim::shiftRegister), 0xFF);
+}
+
+int main()
+{
+    benchmark<8>();
+    benchmark<16>();
+    benchmark<24>();
+    benchmark<32>();
+    return overBudget ? 1 : 0;
+}
@@ -0,0 +1,71 @@
+// Runs main.cpp built with SERIAL_CONFIG_PROTOCOL on the host shim, with UART0 connected to
+// a pseudo terminal, so tools/pedal_serial.py talks to the real protocol code
+// (see serial_protocol_test.py). Prints the path of the terminal, then runs loop() until it
+// is killed. The virtual clock moves LOOP_US per pass.
+
+#include "main.cpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+const uint64_t LOOP_US = 200;
+
+int main()
+{
+    const int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+    {
+        perror("posix_openpt");
+        return 1;
+    }
+
+    // Raw bytes, and the terminal stays open while clients come and go
+    const char *path = ptsname(master);
+    const int slave = open(path, O_RDWR | O_NOCTTY);
+    termios settings;
+    if (slave < 0 || tcgetattr(slave, &settings) != 0)
+    {
+        perror(path);
+        return 1;
+    }
+    cfmakeraw(&settings);
+    tcsetattr(slave, TCSANOW, &settings);
+
+    printf("%s\n", path);
+    fflush(stdout);
+
+    setup();
+    size_t written = Serial.sent.size();
+    for (;;)
+    {
+        pollfd input = {master, POLLIN, 0};
+        if (poll(&input, 1, 1) > 0 && (input.revents & POLLIN))
+        {
+            uint8_t bytes[256];
+            const ssize_t count = read(master, bytes, sizeof(bytes));
+            Serial.rx.insert(Serial.rx.end(), bytes, bytes + max(count, (ssize_t)0));
+        }
+
+        loop();
+        sim::advanceUs(LOOP_US);
+
+        // Everything the pedal sent in this pass
+        std::string bytes;
+        for (; written < Serial.sent.size(); written++)
+        {
+            bytes += (char)Serial.sent[written].byte;
+        }
+        for (size_t sent = 0; sent < bytes.size();)
+        {
+            const ssize_t count = write(master, bytes.data() + sent, bytes.size() - sent);
+            if (count <= 0)
+            {
+                perror("write");
+                return 1;
+            }
+            sent += count;
+        }
+    }
+}
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""Run tools/pedal_serial.py against the pedal firmware over a pseudo terminal.
+
+serial_bridge (main.cpp with SERIAL_CONFIG_PROTOCOL on the host shim) prints the path of
+its terminal. The configuration is read and written with the command line of
+pedal_serial.py, the PUT statuses (204, 304, 400) and a frame with a bad CRC are checked
+with its Pedal class.
+"""
+
+import json
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+
+sys.dont_write_bytecode = True
+HERE = os.path.dirname(os.path.abspath(__file__))
+TOOL = os.path.join(HERE, "..", "tools", "pedal_serial.py")
+sys.path.insert(0, os.path.dirname(TOOL))
+
+try:
+    import serial  # noqa: F401
+except ImportError:
+    print("SKIP: pyserial is not installed (pip install pyserial)")
+    sys.exit(0)
+
+import pedal_serial  # noqa: E402
+
+failures = 0
+
+
+def check(condition, message):
+    global failures
+    if not condition:
+        print("FAIL: %s" % message)
+        failures += 1
+
+
+def run_tool(port, *args):
+    return subprocess.run([sys.executable, TOOL, "--port", port] + list(args), capture_output=True, text=True, timeout=30)
+
+
+def put_status(pedal, document):
+    reply = pedal.request(pedal_serial.PUT_CONFIG, document)
+    return struct.unpack("<H", reply[:2])[0], reply[2:].decode(errors="replace")
+
+
+bridge = subprocess.Popen([os.path.join(HERE, "build", "serial_bridge")], stdout=subprocess.PIPE, text=True)
+try:
+    port = bridge.stdout.readline().strip()
+    with tempfile.TemporaryDirectory() as directory:
+        saved = os.path.join(directory, "config.json")
+
+        print("get")
+        result = run_tool(port, "get", saved)
+        check(result.returncode == 0, "get: %s" % result.stdout)
+        with open(saved) as file:
+            document = json.load(file)
+        check(len(document["buttons"]) == 6, "6 buttons in the document")
+        check(document["buttons"][0]["push"] == "CC 1 80 127,CC 1 80 0", "default TRK P/S on button 1")
+
+        print("put")
+        result = run_tool(port, "put", saved)
+        check(result.returncode == 0 and "No changes" in result.stdout, "put of the same configuration: %s" % result.stdout)
+        document["buttons"][2]["push"] = "PC 1 5 0"
+        with open(saved, "w") as file:
+            json.dump(document, file)
+        result = run_tool(port, "put", saved)
+        check(result.returncode == 0 and "Saved" in result.stdout, "put of a new configuration: %s" % result.stdout)
+        result = run_tool(port, "get")
+        check(json.loads(result.stdout)["buttons"][2]["push"] == "PC 1 5 0", "new configuration read back")
+
+    pedal = pedal_serial.Pedal(port, 115200)
+
+    print("put statuses")
+    document["buttons"][2]["push"] = "PC 1 6 0"
+    check(put_status(pedal, json.dumps(document).encode())[0] == 204, "204 for a new configuration")
+    check(put_status(pedal, json.dumps(document).encode())[0] == 304, "304 for the same configuration")
+    status, message = put_status(pedal, b'{"buttons":[{"push":"CC 1 200 0"}]}')
+    check(status == 400 and message.startswith("400: Invalid MIDI commands"), "400 for invalid commands: %s" % message)
+    status, message = put_status(pedal, b"{")
+    check(status == 400, "400 for invalid JSON: %s" % message)
+
+    print("bad CRC")
+    frame = bytearray(pedal_serial.encode(pedal_serial.PING))
+    frame[-1] ^= 0xFF
+    pedal.serial.write(bytes(frame))
+    check(pedal.read_frame(1.0) is None, "no reply to a frame with a bad CRC")
+    check(struct.unpack("<BB", pedal.request(pedal_serial.PING)) == (1, 6), "ping answered after the bad frame")
+finally:
+    bridge.kill()
+    bridge.wait()
+
+print("%d failures" % failures if failures else "OK")
+sys.exit(1 if failures else 0)
@@ -0,0 +1,82 @@
+// Time and heap allocations to serialize a command list: the String concatenation it
+// replaced (old_serializer.h) against printTo() into a buffer and into a Print sink.
+
+#include "midi_controller.h"
+#include "old_serializer.h"
+
+#include <chrono>
+#include <new>
+
+const uint32_t LISTS = 1000;
+const uint32_t ROUNDS = 50;
+
+// Defined by main.cpp
+void onMIDIButtonVarChanged(MIDIButtonCommands &button) {}
+
+uint64_t allocations = 0;
+
+void *operator new(size_t size)
+{
+    allocations++;
+    void *p = malloc(size);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t size) noexcept
+{
+    free(p);
+}
+
+MIDICommandList lists[LISTS];
+// Keeps the results alive
+size_t total = 0;
+
+template <typename F>
+void benchmark(const char *name, F serialize)
+{
+    const uint64_t before = allocations;
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t round = 0; round < ROUNDS; round++)
+    {
+        for (const MIDICommandList &commandList : lists)
+        {
+            total += serialize(commandList);
+        }
+    }
+    const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (LISTS * ROUNDS);
+    printf("%-26s %7.0f ns per list, %5.1f heap allocations per list\n", name, ns, (double)(allocations - before) / (LISTS * ROUNDS));
+}
+
+int main()
+{
+    CommandListGenerator generator;
+    for (MIDICommandList &commandList : lists)
+    {
+        commandList = generator.list();
+    }
+
+    benchmark("old toString()", [](const MIDICommandList &commandList) {
+        return oldMIDICommandListToString(commandList).length();
+    });
+    benchmark("toString()", [](const MIDICommandList &commandList) {
+        return commandList.toString().length();
+    });
+    benchmark("toChars() into a buffer", [](const MIDICommandList &commandList) {
+        char buffer[32 * 40];
+        return commandList.toChars(buffer, sizeof(buffer));
+    });
+    benchmark("printTo() a Print sink", [](const MIDICommandList &commandList) {
+        CountPrint countPrint;
+        return commandList.printTo(countPrint);
+    });
+    return total == 0;
+}
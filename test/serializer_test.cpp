@@ -0,0 +1,101 @@
+// The command list serializer against the format it replaced (old_serializer.h): byte for
+// byte on generated lists, through printTo(), toChars() and toString(), and without heap
+// allocations when printing to a buffer.
+
+#include "midi_controller.h"
+#include "old_serializer.h"
+
+#include <new>
+
+const uint32_t LISTS = 20000;
+
+int failures = 0;
+
+#define CHECK(condition, message)                                                                                                \
+    do                                                                                                                           \
+    {                                                                                                                            \
+        if (!(condition))                                                                                                        \
+        {                                                                                                                        \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, message);                                                             \
+            failures++;                                                                                                          \
+        }                                                                                                                        \
+    } while (0)
+
+// Defined by main.cpp
+void onMIDIButtonVarChanged(MIDIButtonCommands &button) {}
+
+uint32_t allocations = 0;
+
+void *operator new(size_t size)
+{
+    allocations++;
+    void *p = malloc(size);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t size) noexcept
+{
+    free(p);
+}
+
+int main()
+{
+    CommandListGenerator generator;
+    // Longest list: 32 commands of "CHANNEL_PRESSURE 16 16383 16383 @123" and the commas
+    char buffer[32 * 40];
+    uint32_t mismatches = 0;
+    uint32_t allocating = 0;
+    for (uint32_t i = 0; i < LISTS; i++)
+    {
+        const MIDICommandList commandList = generator.list();
+        const String expected = oldMIDICommandListToString(commandList);
+
+        const uint32_t before = allocations;
+        const size_t length = commandList.toChars(buffer, sizeof(buffer));
+        CountPrint countPrint;
+        commandList.printTo(countPrint);
+        if (allocations != before)
+        {
+            allocating++;
+        }
+
+        if (expected != buffer || length != expected.length() || countPrint.length != expected.length() || commandList.toString() != expected)
+        {
+            if (mismatches++ < 5)
+            {
+                printf("  expected \"%s\"\n  got      \"%s\"\n", expected.c_str(), buffer);
+            }
+        }
+
+        // A short buffer holds the start of the list
+        char shortBuffer[16];
+        commandList.toChars(shortBuffer, sizeof(shortBuffer));
+        if (strncmp(shortBuffer, expected.c_str(), sizeof(shortBuffer) - 1) != 0)
+        {
+            mismatches++;
+        }
+    }
+
+    // toString() of the longest command isn't cut
+    const MIDICommand longest(CHANNEL_PRESSURE, 255, INT32_MAX, INT32_MAX, 0x07);
+    CountPrint longestLength;
+    longest.printTo(longestLength);
+    CHECK(longestLength.length == MIDICommand::TEXT_LENGTH, "TEXT_LENGTH is the longest output");
+    CHECK(longest.toString() == "CHANNEL_PRESSURE 255 2147483647 2147483647 @123", "longest command in full");
+
+    printf("%u lists, %u mismatches, %u printed with heap allocations\n", LISTS, mismatches, allocating);
+    CHECK(mismatches == 0, "same output as the old serializer");
+    CHECK(allocating == 0, "no heap allocation");
+
+    printf(failures ? "%d failures\n" : "OK\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,262 @@
+#include "Arduino.h"
+#include "ESP8266WiFi.h"
+#include "ESP8266mDNS.h"
+#include "LittleFS.h"
+#include "SPI.h"
+#include "coredecls.h"
+extern "C"
+{
+#include "gpio.h"
+#include "user_interface.h"
+}
+
+#include <map>
+
+namespace
+{
+const uint8_t PIN_COUNT = 18;
+const size_t UART_FIFO_SIZE = 128;
+
+uint64_t clockUs = 0;
+// Time spent in light sleep, with the CPU clock stopped
+uint64_t sleptUs = 0;
+// Inputs float HIGH: the footswitches are released
+int pins[PIN_COUNT] = {HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH, HIGH};
+std::multimap<uint64_t, std::pair<uint8_t, int>> pinEvents;
+
+// RTC period, 6.25 us in 1/4096 us
+const uint32_t RTC_CALIBRATION = 25600;
+
+// Light sleep requested with wifi_fpm_do_sleep()
+uint32_t sleepRequestUs = 0;
+fpm_wakeup_cb wakeCallback = nullptr;
+int wakePin = -1;
+} // namespace
+
+namespace sim
+{
+uint8_t shiftRegister[8] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+int analogValue = 0;
+AccessPoint accessPoint;
+
+uint64_t nowUs()
+{
+    return clockUs;
+}
+
+void advanceUs(uint64_t us)
+{
+    const uint64_t end = clockUs + us;
+    while (!pinEvents.empty() && pinEvents.begin()->first <= end)
+    {
+        const auto event = *pinEvents.begin();
+        pinEvents.erase(pinEvents.begin());
+        clockUs = max(clockUs, event.first);
+        pins[event.second.first] = event.second.second;
+    }
+    clockUs = end;
+}
+
+void setPin(uint8_t pin, int level)
+{
+    pins[pin] = level;
+}
+
+void schedulePin(uint64_t atUs, uint8_t pin, int level)
+{
+    pinEvents.emplace(atUs, std::make_pair(pin, level));
+}
+
+int pinLevel(uint8_t pin)
+{
+    return pins[pin];
+}
+
+void runRequestedSleep()
+{
+    if (sleepRequestUs == 0)
+    {
+        return;
+    }
+    uint64_t end = clockUs + sleepRequestUs;
+    sleepRequestUs = 0;
+    if (wakePin >= 0 && pins[wakePin] == LOW)
+    {
+        end = clockUs;
+    }
+    for (auto event = pinEvents.begin(); wakePin >= 0 && event != pinEvents.end() && event->first < end; ++event)
+    {
+        if (event->second.first == wakePin && event->second.second == LOW)
+        {
+            end = event->first;
+        }
+    }
+    const uint64_t start = clockUs;
+    advanceUs(end - start);
+    sleptUs += end - start;
+    if (wakeCallback)
+    {
+        wakeCallback();
+    }
+}
+
+void reboot()
+{
+    clockUs = 0;
+    sleptUs = 0;
+    pinEvents.clear();
+    std::fill(pins, pins + PIN_COUNT, HIGH);
+    Serial.reset();
+    Serial1.reset();
+    WiFi = ESP8266WiFiClass();
+}
+} // namespace sim
+
+unsigned long millis()
+{
+    return (clockUs - sleptUs) / 1000;
+}
+
+unsigned long micros()
+{
+    return clockUs - sleptUs;
+}
+
+void delay(unsigned long ms)
+{
+    sim::advanceUs(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    sim::advanceUs(us);
+}
+
+void yield() {}
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    pins[pin] = value;
+}
+
+int digitalRead(uint8_t pin)
+{
+    return pins[pin];
+}
+
+int analogRead(uint8_t pin)
+{
+    return sim::analogValue;
+}
+
+void esp_schedule() {}
+
+void wifi_fpm_set_sleep_type(sleep_type type) {}
+
+void wifi_fpm_open() {}
+
+void wifi_fpm_close()
+{
+    sleepRequestUs = 0;
+}
+
+void wifi_fpm_set_wakeup_cb(fpm_wakeup_cb cb)
+{
+    wakeCallback = cb;
+}
+
+int8_t wifi_fpm_do_sleep(uint32_t us)
+{
+    sleepRequestUs = us;
+    return 0;
+}
+
+uint32_t system_get_rtc_time()
+{
+    return clockUs * 4096 / RTC_CALIBRATION;
+}
+
+uint32_t system_rtc_clock_cali_proc()
+{
+    return RTC_CALIBRATION;
+}
+
+void gpio_pin_wakeup_enable(uint32_t pin, GPIO_INT_TYPE type)
+{
+    wakePin = pin;
+}
+
+void gpio_pin_wakeup_disable()
+{
+    wakePin = -1;
+}
+
+void HardwareSerial::begin(unsigned long baud)
+{
+    this->baud = baud;
+}
+
+// 10 bits per byte: start, 8 data bits, stop
+static uint64_t byteUs(unsigned long baud)
+{
+    return baud ? 10000000ULL / baud : 0;
+}
+
+int HardwareSerial::availableForWrite()
+{
+    const uint64_t now = sim::nowUs();
+    if (baud == 0 || wireFreeUs <= now)
+    {
+        return UART_FIFO_SIZE;
+    }
+    const uint64_t queued = (wireFreeUs - now + byteUs(baud) - 1) / byteUs(baud);
+    return queued >= UART_FIFO_SIZE ? 0 : UART_FIFO_SIZE - queued;
+}
+
+size_t HardwareSerial::write(uint8_t byte)
+{
+    if (echo)
+    {
+        fputc(byte, stderr);
+    }
+
+    // The core waits for room in the FIFO
+    while (availableForWrite() == 0)
+    {
+        sim::advanceUs(byteUs(baud));
+    }
+    const uint64_t start = max(sim::nowUs(), wireFreeUs);
+    wireFreeUs = start + byteUs(baud);
+    sent.push_back({start, byte});
+    return 1;
+}
+
+void HardwareSerial::flush()
+{
+    if (wireFreeUs > sim::nowUs())
+    {
+        sim::advanceUs(wireFreeUs - sim::nowUs());
+    }
+}
+
+// 8 clocks per byte, button i is bit i % 8 of byte i / 8
+void SPIClass::transfer(void *buffer, uint16_t size)
+{
+    uint8_t *bytes = (uint8_t *)buffer;
+    for (uint16_t i = 0; i < size; i++)
+    {
+        bytes[i] = i < sizeof(sim::shiftRegister) ? sim::shiftRegister[i] : 0xFF;
+    }
+    sim::advanceUs(size * 8 * 1000000ULL / clock);
+}
+
+HardwareSerial Serial("Serial");
+HardwareSerial Serial1("Serial1");
+EspClass ESP;
+SPIClass SPI;
+ESP8266WiFiClass WiFi;
+MDNSResponder MDNS;
+fs::FS SPIFFS;
+fs::FS LittleFS;
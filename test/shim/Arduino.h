@@ -0,0 +1,533 @@
+#pragma once
+
+// Host shim of the ESP8266 Arduino core, enough to build and run main.cpp on a PC.
+// Time is virtual: millis() and micros() only move when the simulator advances the
+// clock (see sim.h) or the code calls delay(), and stop during light sleep. GPIO levels and the bytes written to
+// the UARTs are kept by the simulator.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <algorithm>
+#include <type_traits>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+#define FPSTR(p) (reinterpret_cast<const __FlashStringHelper *>(p))
+
+#define D0 16
+#define D1 5
+#define D2 4
+#define D3 0
+#define D4 2
+#define D5 14
+#define D6 12
+#define D7 13
+#define D8 15
+#define A0 17
+#define LED_BUILTIN 2
+#define LED_BUILTIN_AUX 16
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define MSBFIRST 1
+#define LSBFIRST 0
+
+#define HEX 16
+#define DEC 10
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+inline void *memcpy_P(void *dest, const void *src, size_t length)
+{
+    return memcpy(dest, src, length);
+}
+inline size_t strlen_P(const char *s)
+{
+    return strlen(s);
+}
+inline int strcmp_P(const char *a, const char *b)
+{
+    return strcmp(a, b);
+}
+inline int strncmp_P(const char *a, const char *b, size_t length)
+{
+    return strncmp(a, b, length);
+}
+inline uint8_t pgm_read_byte(const void *p)
+{
+    return *(const uint8_t *)p;
+}
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+
+template <class A, class B>
+typename std::common_type<A, B>::type max(A a, B b)
+{
+    return a > b ? a : b;
+}
+template <class A, class B>
+typename std::common_type<A, B>::type min(A a, B b)
+{
+    return a < b ? a : b;
+}
+#define constrain(x, low, high) ((x) < (low) ? (low) : ((x) > (high) ? (high) : (x)))
+
+class __FlashStringHelper;
+
+// Arduino String on top of std::string
+class String
+{
+public:
+    String() {}
+    String(const char *s) : s(s ? s : "") {}
+    String(const std::string &s) : s(s) {}
+    String(const __FlashStringHelper *s) : s((const char *)s) {}
+    String(char c) : s(1, c) {}
+    explicit String(int value, unsigned char base = 10) : s(format((long)value, base)) {}
+    explicit String(unsigned int value, unsigned char base = 10) : s(format((unsigned long)value, base)) {}
+    explicit String(long value, unsigned char base = 10) : s(format(value, base)) {}
+    explicit String(unsigned long value, unsigned char base = 10) : s(format(value, base)) {}
+    explicit String(unsigned char value, unsigned char base = 10) : s(format((unsigned long)value, base)) {}
+    explicit String(bool value) : s(value ? "1" : "0") {}
+
+    unsigned int length() const
+    {
+        return s.size();
+    }
+    const char *c_str() const
+    {
+        return s.c_str();
+    }
+    bool isEmpty() const
+    {
+        return s.empty();
+    }
+    bool reserve(unsigned int size)
+    {
+        s.reserve(size);
+        return true;
+    }
+    char charAt(unsigned int i) const
+    {
+        return i < s.size() ? s[i] : 0;
+    }
+    char operator[](unsigned int i) const
+    {
+        return charAt(i);
+    }
+    int indexOf(char c, unsigned int from = 0) const
+    {
+        return position(s.find(c, from));
+    }
+    int indexOf(const String &text, unsigned int from = 0) const
+    {
+        return position(s.find(text.s, from));
+    }
+    int lastIndexOf(char c) const
+    {
+        return position(s.rfind(c));
+    }
+    String substring(unsigned int from) const
+    {
+        return from < s.size() ? s.substr(from) : std::string();
+    }
+    String substring(unsigned int from, unsigned int to) const
+    {
+        if (from > to)
+        {
+            std::swap(from, to);
+        }
+        return from < s.size() ? s.substr(from, to - from) : std::string();
+    }
+    long toInt() const
+    {
+        return atol(s.c_str());
+    }
+    void trim()
+    {
+        const size_t first = s.find_first_not_of(" \t\r\n");
+        const size_t last = s.find_last_not_of(" \t\r\n");
+        s = first == std::string::npos ? std::string() : s.substr(first, last - first + 1);
+    }
+    bool startsWith(const String &prefix) const
+    {
+        return s.compare(0, prefix.s.size(), prefix.s) == 0;
+    }
+    bool endsWith(const String &suffix) const
+    {
+        return s.size() >= suffix.s.size() && s.compare(s.size() - suffix.s.size(), suffix.s.size(), suffix.s) == 0;
+    }
+    void remove(unsigned int index)
+    {
+        if (index < s.size())
+        {
+            s.erase(index);
+        }
+    }
+    void remove(unsigned int index, unsigned int count)
+    {
+        if (index < s.size())
+        {
+            s.erase(index, count);
+        }
+    }
+    void replace(const String &from, const String &to)
+    {
+        for (size_t at = s.find(from.s); !from.s.empty() && at != std::string::npos; at = s.find(from.s, at + to.s.size()))
+        {
+            s.replace(at, from.s.size(), to.s);
+        }
+    }
+    bool equals(const String &other) const
+    {
+        return s == other.s;
+    }
+
+    String &operator+=(const String &other)
+    {
+        s += other.s;
+        return *this;
+    }
+    String &operator+=(const char *other)
+    {
+        s += other;
+        return *this;
+    }
+    String &operator+=(char c)
+    {
+        s += c;
+        return *this;
+    }
+    friend String operator+(const String &a, const String &b)
+    {
+        return a.s + b.s;
+    }
+    friend String operator+(const String &a, const char *b)
+    {
+        return a.s + b;
+    }
+    friend String operator+(const char *a, const String &b)
+    {
+        return a + b.s;
+    }
+    friend String operator+(const String &a, char b)
+    {
+        return a.s + b;
+    }
+    bool operator==(const String &other) const
+    {
+        return s == other.s;
+    }
+    bool operator==(const char *other) const
+    {
+        return s == other;
+    }
+    bool operator!=(const String &other) const
+    {
+        return s != other.s;
+    }
+    bool operator!=(const char *other) const
+    {
+        return s != other;
+    }
+    bool operator<(const String &other) const
+    {
+        return s < other.s;
+    }
+
+    std::string s;
+
+private:
+    static int position(size_t at)
+    {
+        return at == std::string::npos ? -1 : (int)at;
+    }
+
+    static std::string format(unsigned long value, unsigned char base)
+    {
+        char buffer[24];
+        snprintf(buffer, sizeof(buffer), base == 16 ? "%lx" : "%lu", value);
+        return buffer;
+    }
+
+    static std::string format(long value, unsigned char base)
+    {
+        if (base != 10)
+        {
+            return format((unsigned long)value, base);
+        }
+        return std::to_string(value);
+    }
+};
+
+class Print;
+
+class Printable
+{
+public:
+    virtual ~Printable() {}
+    virtual size_t printTo(Print &out) const = 0;
+};
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t byte) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+        size_t written = 0;
+        while (size--)
+        {
+            written += write(*buffer++);
+        }
+        return written;
+    }
+    size_t write(const char *s)
+    {
+        return write((const uint8_t *)s, strlen(s));
+    }
+    size_t write(const char *buffer, size_t size)
+    {
+        return write((const uint8_t *)buffer, size);
+    }
+    virtual int availableForWrite()
+    {
+        return 0;
+    }
+    virtual void flush() {}
+
+    size_t print(const char *s)
+    {
+        return write(s);
+    }
+    size_t print(const String &s)
+    {
+        return write((const uint8_t *)s.c_str(), s.length());
+    }
+    size_t print(const __FlashStringHelper *s)
+    {
+        return write((const char *)s);
+    }
+    size_t print(char c)
+    {
+        return write((uint8_t)c);
+    }
+    // Numbers are printed from a stack buffer, like the core: no heap allocation.
+    // long is 32 bits on the ESP8266
+    size_t print(int value, int base = DEC)
+    {
+        return print((long)value, base);
+    }
+    size_t print(unsigned int value, int base = DEC)
+    {
+        return printNumber(value, base);
+    }
+    size_t print(long value, int base = DEC)
+    {
+        if (base == DEC && value < 0)
+        {
+            return print('-') + printNumber(-(int64_t)value, base);
+        }
+        return printNumber((uint32_t)value, base);
+    }
+    size_t print(unsigned long value, int base = DEC)
+    {
+        return printNumber((uint32_t)value, base);
+    }
+    size_t print(unsigned char value, int base = DEC)
+    {
+        return printNumber(value, base);
+    }
+    size_t print(const Printable &printable)
+    {
+        return printable.printTo(*this);
+    }
+
+    template <typename T>
+    size_t println(const T &value)
+    {
+        const size_t written = print(value);
+        return written + println();
+    }
+    size_t println()
+    {
+        return write("\r\n");
+    }
+
+private:
+    size_t printNumber(uint32_t value, int base)
+    {
+        char buffer[33];
+        char *digit = buffer + sizeof(buffer) - 1;
+        *digit = '\0';
+        if (base < 2)
+        {
+            base = 10;
+        }
+        do
+        {
+            const uint8_t remainder = value % base;
+            value /= base;
+            *--digit = remainder < 10 ? '0' + remainder : 'A' + remainder - 10;
+        } while (value);
+        return write(digit);
+    }
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    size_t readBytes(uint8_t *buffer, size_t length)
+    {
+        size_t count = 0;
+        while (count < length && available() > 0)
+        {
+            buffer[count++] = read();
+        }
+        return count;
+    }
+    size_t readBytes(char *buffer, size_t length)
+    {
+        return readBytes((uint8_t *)buffer, length);
+    }
+    String readStringUntil(char terminator)
+    {
+        String text;
+        while (available() > 0)
+        {
+            const int c = read();
+            if (c == terminator)
+            {
+                break;
+            }
+            text += (char)c;
+        }
+        return text;
+    }
+    String readString()
+    {
+        String text;
+        while (available() > 0)
+        {
+            text += (char)read();
+        }
+        return text;
+    }
+};
+
+// UART with a 128 byte transmit FIFO drained at the baud rate of begin(). Every byte is
+// recorded with the virtual time it starts on the wire.
+class HardwareSerial : public Stream
+{
+public:
+    struct SentByte
+    {
+        uint64_t us;
+        uint8_t byte;
+    };
+
+    explicit HardwareSerial(const char *name) : name(name) {}
+
+    void begin(unsigned long baud);
+    void end() {}
+    size_t write(uint8_t byte) override;
+    using Print::write;
+    int availableForWrite() override;
+    void flush() override;
+    int available() override
+    {
+        return rx.size();
+    }
+    int read() override
+    {
+        if (rx.empty())
+        {
+            return -1;
+        }
+        const uint8_t byte = rx.front();
+        rx.pop_front();
+        return byte;
+    }
+    int peek() override
+    {
+        return rx.empty() ? -1 : rx.front();
+    }
+    operator bool() const
+    {
+        return true;
+    }
+    // Power on: nothing sent or received yet
+    void reset()
+    {
+        sent.clear();
+        rx.clear();
+        wireFreeUs = 0;
+    }
+
+    const char *name;
+    unsigned long baud = 0;
+    // Bytes sent since the last clear, with the time they started on the wire
+    std::vector<SentByte> sent;
+    // Bytes to be received
+    std::deque<uint8_t> rx;
+    // Copy the bytes written to stderr, for the debug console
+    bool echo = false;
+
+private:
+    // End of the transmission of the last byte in the FIFO
+    uint64_t wireFreeUs = 0;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+
+class EspClass
+{
+public:
+    uint32_t getFreeHeap()
+    {
+        return 40000;
+    }
+    uint32_t getMaxFreeBlockSize()
+    {
+        return 30000;
+    }
+    uint8_t getHeapFragmentation()
+    {
+        return 0;
+    }
+    uint32_t getChipId()
+    {
+        return 0x1a2b3c;
+    }
+};
+
+extern EspClass ESP;
+
+#include "sim.h"
@@ -0,0 +1,449 @@
+#pragma once
+
+// Types of ArduinoJson 7 used by config_document.h and main.cpp, on a small recursive
+// descent parser. Like ArduinoJson, deserializeJson() stops after the first value, and
+// variant | fallback only returns the value when it has the type of the fallback.
+
+#include "Arduino.h"
+
+#include <memory>
+
+struct JsonNode
+{
+    enum Type
+    {
+        Null,
+        Bool,
+        Integer,
+        Float,
+        Text,
+        Array,
+        Object
+    };
+
+    Type type = Null;
+    bool boolean = false;
+    long long integer = 0;
+    double number = 0;
+    std::string text;
+    std::vector<std::shared_ptr<JsonNode>> items;
+    std::vector<std::pair<std::string, std::shared_ptr<JsonNode>>> members;
+};
+
+struct JsonObjectConst;
+struct JsonArrayConst;
+
+struct JsonVariantConst
+{
+    JsonVariantConst() {}
+    JsonVariantConst(std::shared_ptr<const JsonNode> node) : node(node) {}
+
+    bool isNull() const
+    {
+        return !node || node->type == JsonNode::Null;
+    }
+    JsonVariantConst operator[](const char *key) const
+    {
+        if (node && node->type == JsonNode::Object)
+        {
+            for (const auto &member : node->members)
+            {
+                if (member.first == key)
+                {
+                    return JsonVariantConst(member.second);
+                }
+            }
+        }
+        return JsonVariantConst();
+    }
+    operator JsonArrayConst() const;
+    operator JsonObjectConst() const;
+    const char *operator|(const char *fallback) const
+    {
+        return node && node->type == JsonNode::Text ? node->text.c_str() : fallback;
+    }
+    int operator|(int fallback) const
+    {
+        return node && node->type == JsonNode::Integer ? (int)node->integer : fallback;
+    }
+    bool operator|(bool fallback) const
+    {
+        return node && node->type == JsonNode::Bool ? node->boolean : fallback;
+    }
+
+    std::shared_ptr<const JsonNode> node;
+};
+
+struct JsonObjectConst
+{
+    JsonObjectConst() {}
+    JsonObjectConst(std::shared_ptr<const JsonNode> node) : node(node) {}
+
+    bool isNull() const
+    {
+        return !node || node->type != JsonNode::Object;
+    }
+    JsonVariantConst operator[](const char *key) const
+    {
+        return JsonVariantConst(isNull() ? nullptr : node)[key];
+    }
+
+    std::shared_ptr<const JsonNode> node;
+};
+
+struct JsonArrayConst
+{
+    class iterator
+    {
+    public:
+        iterator(const std::shared_ptr<JsonNode> *item) : item(item) {}
+        JsonObjectConst operator*() const
+        {
+            return JsonObjectConst(*item);
+        }
+        iterator &operator++()
+        {
+            item++;
+            return *this;
+        }
+        bool operator!=(const iterator &other) const
+        {
+            return item != other.item;
+        }
+
+    private:
+        const std::shared_ptr<JsonNode> *item;
+    };
+
+    JsonArrayConst() {}
+    JsonArrayConst(std::shared_ptr<const JsonNode> node) : node(node) {}
+
+    bool isNull() const
+    {
+        return !node || node->type != JsonNode::Array;
+    }
+    size_t size() const
+    {
+        return isNull() ? 0 : node->items.size();
+    }
+    iterator begin() const
+    {
+        return iterator(isNull() ? nullptr : node->items.data());
+    }
+    iterator end() const
+    {
+        return iterator(isNull() ? nullptr : node->items.data() + node->items.size());
+    }
+
+    std::shared_ptr<const JsonNode> node;
+};
+
+inline JsonVariantConst::operator JsonArrayConst() const
+{
+    return JsonArrayConst(node);
+}
+
+inline JsonVariantConst::operator JsonObjectConst() const
+{
+    return JsonObjectConst(node);
+}
+
+struct JsonDocument
+{
+    operator JsonVariantConst() const
+    {
+        return JsonVariantConst(root);
+    }
+    JsonVariantConst operator[](const char *key) const
+    {
+        return JsonVariantConst(root)[key];
+    }
+
+    std::shared_ptr<JsonNode> root;
+};
+
+struct DeserializationError
+{
+    enum Code
+    {
+        Ok,
+        EmptyInput,
+        IncompleteInput,
+        InvalidInput
+    };
+
+    DeserializationError(Code code) : code(code) {}
+    explicit operator bool() const
+    {
+        return code != Ok;
+    }
+    const char *c_str() const
+    {
+        const char *const names[] = {"Ok", "EmptyInput", "IncompleteInput", "InvalidInput"};
+        return names[code];
+    }
+
+    Code code;
+};
+
+class JsonParser
+{
+public:
+    JsonParser(const char *json, size_t length) : p(json), end(json + length) {}
+
+    DeserializationError parse(JsonDocument &document)
+    {
+        skipSpaces();
+        if (p == end)
+        {
+            return DeserializationError::EmptyInput;
+        }
+        document.root = std::make_shared<JsonNode>();
+        return value(*document.root);
+    }
+
+private:
+    const char *p;
+    const char *end;
+
+    void skipSpaces()
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+        {
+            p++;
+        }
+    }
+
+    DeserializationError literal(const char *word)
+    {
+        for (; *word; word++, p++)
+        {
+            if (p == end)
+            {
+                return DeserializationError::IncompleteInput;
+            }
+            if (*p != *word)
+            {
+                return DeserializationError::InvalidInput;
+            }
+        }
+        return DeserializationError::Ok;
+    }
+
+    DeserializationError value(JsonNode &node)
+    {
+        skipSpaces();
+        if (p == end)
+        {
+            return DeserializationError::IncompleteInput;
+        }
+        switch (*p)
+        {
+        case '{':
+            return object(node);
+        case '[':
+            return array(node);
+        case '"':
+            node.type = JsonNode::Text;
+            return string(node.text);
+        case 't':
+            node.type = JsonNode::Bool;
+            node.boolean = true;
+            return literal("true");
+        case 'f':
+            node.type = JsonNode::Bool;
+            return literal("false");
+        case 'n':
+            return literal("null");
+        default:
+            return number(node);
+        }
+    }
+
+    DeserializationError object(JsonNode &node)
+    {
+        node.type = JsonNode::Object;
+        p++;
+        skipSpaces();
+        if (p < end && *p == '}')
+        {
+            p++;
+            return DeserializationError::Ok;
+        }
+        for (;;)
+        {
+            skipSpaces();
+            if (p == end)
+            {
+                return DeserializationError::IncompleteInput;
+            }
+            std::string key;
+            if (*p != '"')
+            {
+                return DeserializationError::InvalidInput;
+            }
+            DeserializationError error = string(key);
+            if (error)
+            {
+                return error;
+            }
+            skipSpaces();
+            if (p == end)
+            {
+                return DeserializationError::IncompleteInput;
+            }
+            if (*p++ != ':')
+            {
+                return DeserializationError::InvalidInput;
+            }
+            auto member = std::make_shared<JsonNode>();
+            error = value(*member);
+            if (error)
+            {
+                return error;
+            }
+            node.members.emplace_back(key, member);
+            bool closed;
+            error = separator('}', closed);
+            if (error || closed)
+            {
+                return error;
+            }
+        }
+    }
+
+    DeserializationError array(JsonNode &node)
+    {
+        node.type = JsonNode::Array;
+        p++;
+        skipSpaces();
+        if (p < end && *p == ']')
+        {
+            p++;
+            return DeserializationError::Ok;
+        }
+        for (;;)
+        {
+            auto item = std::make_shared<JsonNode>();
+            DeserializationError error = value(*item);
+            if (error)
+            {
+                return error;
+            }
+            node.items.push_back(item);
+            bool closed;
+            error = separator(']', closed);
+            if (error || closed)
+            {
+                return error;
+            }
+        }
+    }
+
+    // After a member or an item: a comma goes on to the next one, close ends the container
+    DeserializationError separator(char close, bool &closed)
+    {
+        skipSpaces();
+        if (p == end)
+        {
+            return DeserializationError::IncompleteInput;
+        }
+        const char c = *p++;
+        closed = c == close;
+        return c == ',' || closed ? DeserializationError::Ok : DeserializationError::InvalidInput;
+    }
+
+    DeserializationError string(std::string &text)
+    {
+        p++;
+        while (p < end && *p != '"')
+        {
+            if (*p != '\\')
+            {
+                text += *p++;
+                continue;
+            }
+            if (++p == end)
+            {
+                return DeserializationError::IncompleteInput;
+            }
+            const char escape = *p++;
+            const char *const escapes = "\"\"\\\\//b\bf\fn\nr\rt\t";
+            const char *match = strchr(escapes, escape);
+            if (escape != 'u' && (match == nullptr || (match - escapes) % 2))
+            {
+                return DeserializationError::InvalidInput;
+            }
+            if (escape != 'u')
+            {
+                text += match[1];
+                continue;
+            }
+            if (end - p < 4)
+            {
+                return DeserializationError::IncompleteInput;
+            }
+            const unsigned long code = strtoul(std::string(p, 4).c_str(), nullptr, 16);
+            p += 4;
+            // UTF-8, without surrogate pairs
+            if (code < 0x80)
+            {
+                text += (char)code;
+            }
+            else if (code < 0x800)
+            {
+                text += (char)(0xC0 | code >> 6);
+                text += (char)(0x80 | (code & 0x3F));
+            }
+            else
+            {
+                text += (char)(0xE0 | code >> 12);
+                text += (char)(0x80 | ((code >> 6) & 0x3F));
+                text += (char)(0x80 | (code & 0x3F));
+            }
+        }
+        if (p == end)
+        {
+            return DeserializationError::IncompleteInput;
+        }
+        p++;
+        return DeserializationError::Ok;
+    }
+
+    DeserializationError number(JsonNode &node)
+    {
+        const char *start = p;
+        bool integer = true;
+        if (p < end && *p == '-')
+        {
+            p++;
+        }
+        while (p < end && (isdigit((unsigned char)*p) || *p == '.' || *p == 'e' || *p == 'E' || *p == '+' || *p == '-'))
+        {
+            integer = integer && isdigit((unsigned char)*p);
+            p++;
+        }
+        const std::string text(start, p);
+        if (text.empty() || text == "-")
+        {
+            return p == end ? DeserializationError::IncompleteInput : DeserializationError::InvalidInput;
+        }
+        char *parsed;
+        if (integer)
+        {
+            node.type = JsonNode::Integer;
+            node.integer = strtoll(text.c_str(), &parsed, 10);
+        }
+        else
+        {
+            node.type = JsonNode::Float;
+            node.number = strtod(text.c_str(), &parsed);
+        }
+        return *parsed ? DeserializationError::InvalidInput : DeserializationError::Ok;
+    }
+};
+
+inline DeserializationError deserializeJson(JsonDocument &document, const char *json, size_t length)
+{
+    return JsonParser(json, length).parse(document);
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+// Station connecting to the access point of sim::accessPoint, in virtual time: a connection
+// on a given channel and BSSID takes the association and the DHCP lease, without them it
+// scans first
+
+#include "Arduino.h"
+
+typedef enum
+{
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+enum WiFiMode_t
+{
+    WIFI_OFF = 0,
+    WIFI_STA = 1
+};
+
+class IPAddress : public Printable
+{
+public:
+    IPAddress() {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : address(a | b << 8 | c << 16 | (uint32_t)d << 24) {}
+    IPAddress(uint32_t address) : address(address) {}
+    operator uint32_t() const
+    {
+        return address;
+    }
+    size_t printTo(Print &out) const override
+    {
+        return out.print(String(address & 0xFF) + "." + String((address >> 8) & 0xFF) + "." + String((address >> 16) & 0xFF) + "." +
+                         String(address >> 24));
+    }
+
+private:
+    uint32_t address = 0;
+};
+
+class ESP8266WiFiClass
+{
+public:
+    wl_status_t status()
+    {
+        return connecting && sim::nowUs() >= connectedUs ? WL_CONNECTED : WL_DISCONNECTED;
+    }
+    bool persistent(bool persistent)
+    {
+        return true;
+    }
+    bool mode(WiFiMode_t mode)
+    {
+        if (mode == WIFI_OFF)
+        {
+            disconnect();
+        }
+        return true;
+    }
+    // Never connects when the network, the channel or the BSSID don't match the access point
+    wl_status_t begin(const char *ssid, const char *password, int32_t channel = 0, const uint8_t *bssid = nullptr, bool connect = true)
+    {
+        const sim::AccessPoint &ap = sim::accessPoint;
+        connecting = ap.ssid && strcmp(ssid, ap.ssid) == 0 && strcmp(password, ap.password) == 0 && (channel == 0 || channel == ap.channel) &&
+                     (!bssid || memcmp(bssid, ap.bssid, sizeof(ap.bssid)) == 0);
+        connectedUs = sim::nowUs() + (channel == 0 ? sim::WIFI_SCAN_US : 0) + sim::WIFI_ASSOCIATE_US + (staticIP ? 0 : sim::WIFI_DHCP_US);
+        return status();
+    }
+    bool config(IPAddress ip, IPAddress gateway, IPAddress subnet, IPAddress dns = IPAddress())
+    {
+        staticIP = ip != 0;
+        return true;
+    }
+    bool disconnect(bool wifiOff = false)
+    {
+        connecting = false;
+        return true;
+    }
+    bool forceSleepBegin(uint32_t us = 0)
+    {
+        return true;
+    }
+    bool forceSleepWake()
+    {
+        return true;
+    }
+    String SSID()
+    {
+        return status() == WL_CONNECTED ? String(sim::accessPoint.ssid) : String();
+    }
+    uint8_t *BSSID()
+    {
+        return sim::accessPoint.bssid;
+    }
+    String BSSIDstr()
+    {
+        char bssid[18];
+        const uint8_t *b = sim::accessPoint.bssid;
+        snprintf(bssid, sizeof(bssid), "%02X:%02X:%02X:%02X:%02X:%02X", b[0], b[1], b[2], b[3], b[4], b[5]);
+        return String(bssid);
+    }
+    int32_t channel()
+    {
+        return status() == WL_CONNECTED ? sim::accessPoint.channel : 0;
+    }
+    IPAddress localIP()
+    {
+        return status() == WL_CONNECTED ? IPAddress(192, 168, 1, 50) : IPAddress();
+    }
+    IPAddress gatewayIP()
+    {
+        return status() == WL_CONNECTED ? IPAddress(192, 168, 1, 1) : IPAddress();
+    }
+    IPAddress subnetMask()
+    {
+        return status() == WL_CONNECTED ? IPAddress(255, 255, 255, 0) : IPAddress();
+    }
+    IPAddress dnsIP(uint8_t index = 0)
+    {
+        return gatewayIP();
+    }
+
+private:
+    bool connecting = false;
+    uint64_t connectedUs = 0;
+    bool staticIP = false;
+};
+
+extern ESP8266WiFiClass WiFi;
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "ESP8266WiFi.h"
+
+// Scans, then connects to the access point if it is one of the known networks
+class ESP8266WiFiMulti
+{
+public:
+    bool addAP(const char *ssid, const char *password)
+    {
+        networks.emplace_back(ssid, password);
+        return true;
+    }
+    wl_status_t run(uint32_t timeoutMs = 5000)
+    {
+        if (WiFi.status() == WL_CONNECTED)
+        {
+            return WL_CONNECTED;
+        }
+        sim::advanceUs(sim::WIFI_SCAN_US);
+        const sim::AccessPoint &ap = sim::accessPoint;
+        for (const auto &network : networks)
+        {
+            if (ap.ssid && network.first == ap.ssid)
+            {
+                WiFi.begin(network.first.c_str(), network.second.c_str(), ap.channel, ap.bssid);
+                const uint64_t start = sim::nowUs();
+                while (WiFi.status() != WL_CONNECTED && sim::nowUs() - start < timeoutMs * 1000ULL)
+                {
+                    sim::advanceUs(10000);
+                }
+                break;
+            }
+        }
+        return WiFi.status();
+    }
+
+    // Known networks, to check they are added once
+    std::vector<std::pair<std::string, std::string>> networks;
+};
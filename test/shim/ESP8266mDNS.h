@@ -0,0 +1,68 @@
+#pragma once
+
+// Keeps the host name and the TXT callback, txt() answers like a query of the service
+// would (see http_bridge.cpp)
+
+#include "ESP8266WiFi.h"
+
+#include <map>
+
+class MDNSResponder
+{
+public:
+    typedef const void *hMDNSService;
+    typedef std::function<void(const hMDNSService)> MDNSDynamicServiceTxtCallbackFunc;
+
+    bool begin(const String &hostname)
+    {
+        this->hostname = hostname;
+        return true;
+    }
+    bool update()
+    {
+        return true;
+    }
+    bool close()
+    {
+        hostname = String();
+        txtCallback = nullptr;
+        return true;
+    }
+    bool announce()
+    {
+        return true;
+    }
+    hMDNSService addService(const char *name, const char *service, const char *protocol, uint16_t port)
+    {
+        return this;
+    }
+    bool setDynamicServiceTxtCallback(MDNSDynamicServiceTxtCallbackFunc callback)
+    {
+        txtCallback = callback;
+        return true;
+    }
+    const void *addDynamicServiceTxt(hMDNSService service, const char *key, const char *value)
+    {
+        txtItems[key] = value;
+        return this;
+    }
+
+    // Value of a TXT item of the service, empty when it isn't published
+    String txt(const char *key)
+    {
+        txtItems.clear();
+        if (txtCallback)
+        {
+            txtCallback(this);
+        }
+        return txtItems.count(key) ? txtItems[key] : String();
+    }
+
+    String hostname;
+
+private:
+    MDNSDynamicServiceTxtCallbackFunc txtCallback;
+    std::map<std::string, String> txtItems;
+};
+
+extern MDNSResponder MDNS;
@@ -0,0 +1,293 @@
+#pragma once
+
+// The routes, handlers and static files are registered as on the pedal, and request()
+// runs one request through them in the same order as ESPAsyncWebServer: the handlers
+// added with addHandler() and the routes in the order they were added, then the not
+// found handler. The body is passed to the body callback in one piece.
+
+#include "FS.h"
+#include "ESP8266WiFi.h"
+
+#include <map>
+#include <memory>
+
+enum WebRequestMethod
+{
+    HTTP_GET = 1,
+    HTTP_POST = 2,
+    HTTP_PUT = 4,
+    HTTP_ANY = 127
+};
+
+class AsyncWebServerResponse
+{
+public:
+    AsyncWebServerResponse(int code = 200, const String &content = String()) : code(code), content(content) {}
+    virtual ~AsyncWebServerResponse() {}
+    void addHeader(const String &name, const String &value)
+    {
+        headers[name.c_str()] = value;
+    }
+
+    int code;
+    String content;
+    std::map<std::string, String> headers;
+};
+
+class AsyncResponseStream : public AsyncWebServerResponse, public Print
+{
+public:
+    size_t write(uint8_t byte) override
+    {
+        content += (char)byte;
+        return 1;
+    }
+    using Print::write;
+};
+
+class AsyncWebHeader
+{
+public:
+    AsyncWebHeader(const String &name, const String &value) : name_(name), value_(value) {}
+    const String &name() const
+    {
+        return name_;
+    }
+    const String &value() const
+    {
+        return value_;
+    }
+
+private:
+    String name_;
+    String value_;
+};
+
+class AsyncWebServerRequest
+{
+public:
+    AsyncWebServerRequest(WebRequestMethod method, const String &url, const String &body, const std::map<std::string, String> &headers)
+        : method(method), url(url), body(body), headers(headers)
+    {
+    }
+    ~AsyncWebServerRequest()
+    {
+        free(_tempObject);
+        if (disconnect)
+        {
+            disconnect();
+        }
+    }
+
+    size_t contentLength() const
+    {
+        return body.length();
+    }
+    bool hasHeader(const String &name) const
+    {
+        return headers.count(name.c_str()) > 0;
+    }
+    AsyncWebHeader *getHeader(const String &name)
+    {
+        const auto header = headers.find(name.c_str());
+        if (header == headers.end())
+        {
+            return nullptr;
+        }
+        headerObjects.emplace_back(new AsyncWebHeader(name, header->second));
+        return headerObjects.back().get();
+    }
+    void onDisconnect(std::function<void()> callback)
+    {
+        disconnect = callback;
+    }
+    void send(int code, const String &contentType = String(), const String &content = String())
+    {
+        response.reset(new AsyncWebServerResponse(code, content));
+    }
+    void send(AsyncWebServerResponse *response)
+    {
+        this->response.reset(response);
+    }
+    AsyncWebServerResponse *beginResponse(int code, const String &contentType = String(), const String &content = String())
+    {
+        return new AsyncWebServerResponse(code, content);
+    }
+    AsyncResponseStream *beginResponseStream(const String &contentType, size_t bufferSize = 1460)
+    {
+        return new AsyncResponseStream();
+    }
+    void *_tempObject = nullptr;
+
+    const WebRequestMethod method;
+    const String url;
+    const String body;
+    // Header names as sent by the client
+    const std::map<std::string, String> headers;
+    std::unique_ptr<AsyncWebServerResponse> response;
+
+private:
+    std::function<void()> disconnect;
+    std::vector<std::unique_ptr<AsyncWebHeader>> headerObjects;
+};
+
+typedef std::function<void(AsyncWebServerRequest *)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *, const String &, size_t, uint8_t *, size_t, bool)> ArUploadHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *, uint8_t *, size_t, size_t, size_t)> ArBodyHandlerFunction;
+
+class AsyncWebHandler
+{
+public:
+    virtual ~AsyncWebHandler() {}
+    virtual bool canHandle(AsyncWebServerRequest *request)
+    {
+        return false;
+    }
+    virtual void handleRequest(AsyncWebServerRequest *request) {}
+};
+
+// Files of fs under path for the URLs under uri, the .gz file is sent when it exists
+class AsyncStaticWebHandler : public AsyncWebHandler
+{
+public:
+    AsyncStaticWebHandler(const char *uri, fs::FS &fs, const char *path) : uri(uri), fs(fs), path(path) {}
+
+    bool canHandle(AsyncWebServerRequest *request) override
+    {
+        if (request->method != HTTP_GET || request->url.indexOf(uri) != 0)
+        {
+            return false;
+        }
+        file = path + request->url.substring(uri.length());
+        if (!fs.exists(file) && fs.exists(file + ".gz"))
+        {
+            file += ".gz";
+        }
+        return fs.exists(file);
+    }
+
+    void handleRequest(AsyncWebServerRequest *request) override
+    {
+        File content = fs.open(file, "r");
+        request->send(200, "application/octet-stream", content.readString());
+    }
+
+private:
+    const String uri;
+    fs::FS &fs;
+    const String path;
+    String file;
+};
+
+class AsyncCallbackWebHandler : public AsyncWebHandler
+{
+public:
+    AsyncCallbackWebHandler(const char *uri, WebRequestMethod method, ArRequestHandlerFunction onRequest, ArBodyHandlerFunction onBody)
+        : uri(uri), method(method), onRequest(onRequest), onBody(onBody)
+    {
+    }
+
+    bool canHandle(AsyncWebServerRequest *request) override
+    {
+        return (request->method & method) && request->url == uri;
+    }
+
+    void handleRequest(AsyncWebServerRequest *request) override
+    {
+        if (onBody && request->body.length() > 0)
+        {
+            onBody(request, (uint8_t *)request->body.c_str(), request->body.length(), 0, request->body.length());
+        }
+        onRequest(request);
+    }
+
+private:
+    const String uri;
+    const WebRequestMethod method;
+    ArRequestHandlerFunction onRequest;
+    ArBodyHandlerFunction onBody;
+};
+
+class AsyncWebServer
+{
+public:
+    AsyncWebServer(uint16_t port) {}
+    void begin()
+    {
+        running = true;
+    }
+    void end()
+    {
+        running = false;
+    }
+    AsyncWebHandler &addHandler(AsyncWebHandler *handler)
+    {
+        handlers.emplace_back(handler);
+        return *handler;
+    }
+    void on(const char *uri, WebRequestMethod method, ArRequestHandlerFunction onRequest)
+    {
+        routes++;
+        chain.emplace_back(new AsyncCallbackWebHandler(uri, method, onRequest, nullptr));
+    }
+    void on(const char *uri, WebRequestMethod method, ArRequestHandlerFunction onRequest, ArUploadHandlerFunction onUpload,
+            ArBodyHandlerFunction onBody)
+    {
+        routes++;
+        chain.emplace_back(new AsyncCallbackWebHandler(uri, method, onRequest, onBody));
+    }
+    void serveStatic(const char *uri, fs::FS &fs, const char *path)
+    {
+        chain.emplace_back(new AsyncStaticWebHandler(uri, fs, path));
+    }
+    void onNotFound(ArRequestHandlerFunction onRequest)
+    {
+        notFound = onRequest;
+    }
+
+    // Run a request, returns its response (code 0 when the server isn't running or nothing answered)
+    AsyncWebServerResponse request(WebRequestMethod method, const String &url, const String &body = String(),
+                                   const std::map<std::string, String> &headers = {})
+    {
+        if (!running)
+        {
+            return AsyncWebServerResponse(0);
+        }
+        AsyncWebServerRequest request(method, url, body, headers);
+        AsyncWebHandler *handler = nullptr;
+        for (auto &candidate : handlers)
+        {
+            if (candidate->canHandle(&request))
+            {
+                handler = candidate.get();
+                break;
+            }
+        }
+        for (auto &candidate : chain)
+        {
+            if (!handler && candidate->canHandle(&request))
+            {
+                handler = candidate.get();
+            }
+        }
+        if (handler)
+        {
+            handler->handleRequest(&request);
+        }
+        else if (notFound)
+        {
+            notFound(&request);
+        }
+        return request.response ? *request.response : AsyncWebServerResponse(0);
+    }
+
+    // Registered so far, to check they are registered once
+    std::vector<std::unique_ptr<AsyncWebHandler>> handlers;
+    unsigned routes = 0;
+    bool running = false;
+
+private:
+    // Routes and static files, in the order they were added
+    std::vector<std::shared_ptr<AsyncWebHandler>> chain;
+    ArRequestHandlerFunction notFound;
+};
@@ -0,0 +1,192 @@
+#pragma once
+
+// File and FS wrappers of the ESP8266 core over an FSImpl. A FS without an
+// implementation (SPIFFS and LittleFS here) fails every operation.
+
+#include "Arduino.h"
+#include "FSImpl.h"
+
+namespace fs
+{
+class File : public Stream
+{
+public:
+    File(FileImplPtr p = FileImplPtr()) : p(p) {}
+
+    size_t write(uint8_t byte) override
+    {
+        return write(&byte, 1);
+    }
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        return p ? p->write(buffer, size) : 0;
+    }
+    using Print::write;
+    int available() override
+    {
+        return p ? p->size() - p->position() : 0;
+    }
+    int read() override
+    {
+        uint8_t byte;
+        return p && p->read(&byte, 1) == 1 ? byte : -1;
+    }
+    int read(uint8_t *buffer, size_t size)
+    {
+        return p ? p->read(buffer, size) : -1;
+    }
+    int peek() override
+    {
+        if (!p)
+        {
+            return -1;
+        }
+        const size_t position = p->position();
+        const int byte = read();
+        p->seek(position, SeekSet);
+        return byte;
+    }
+    void flush() override
+    {
+        if (p)
+        {
+            p->flush();
+        }
+    }
+    bool seek(uint32_t pos, SeekMode mode = SeekSet)
+    {
+        return p && p->seek(pos, mode);
+    }
+    size_t position() const
+    {
+        return p ? p->position() : 0;
+    }
+    size_t size() const
+    {
+        return p ? p->size() : 0;
+    }
+    bool truncate(uint32_t size)
+    {
+        return p && p->truncate(size);
+    }
+    void close()
+    {
+        if (p)
+        {
+            p->close();
+            p.reset();
+        }
+    }
+    operator bool() const
+    {
+        return !!p;
+    }
+    const char *name() const
+    {
+        return p ? p->name() : "";
+    }
+    const char *fullName() const
+    {
+        return p ? p->fullName() : "";
+    }
+    bool isFile() const
+    {
+        return p && p->isFile();
+    }
+    bool isDirectory() const
+    {
+        return p && p->isDirectory();
+    }
+
+private:
+    FileImplPtr p;
+};
+
+class FS
+{
+public:
+    FS(FSImplPtr impl = FSImplPtr()) : impl(impl) {}
+
+    bool begin()
+    {
+        return impl && impl->begin();
+    }
+    void end()
+    {
+        if (impl)
+        {
+            impl->end();
+        }
+    }
+    bool format()
+    {
+        return impl && impl->format();
+    }
+
+    // "r", "w", "a", "r+", "w+", "a+" as fopen()
+    File open(const char *path, const char *mode)
+    {
+        if (!impl)
+        {
+            return File();
+        }
+        OpenMode openMode = OM_DEFAULT;
+        AccessMode accessMode = AM_READ;
+        if (mode[0] == 'w')
+        {
+            openMode = OpenMode(OM_CREATE | OM_TRUNCATE);
+            accessMode = AM_WRITE;
+        }
+        else if (mode[0] == 'a')
+        {
+            openMode = OpenMode(OM_CREATE | OM_APPEND);
+            accessMode = AM_WRITE;
+        }
+        if (mode[1] == '+')
+        {
+            accessMode = AM_RW;
+        }
+        return File(impl->open(path, openMode, accessMode));
+    }
+    File open(const String &path, const char *mode)
+    {
+        return open(path.c_str(), mode);
+    }
+    bool exists(const char *path)
+    {
+        return impl && impl->exists(path);
+    }
+    bool exists(const String &path)
+    {
+        return exists(path.c_str());
+    }
+    bool remove(const char *path)
+    {
+        return impl && impl->remove(path);
+    }
+    bool remove(const String &path)
+    {
+        return remove(path.c_str());
+    }
+    bool rename(const char *pathFrom, const char *pathTo)
+    {
+        return impl && impl->rename(pathFrom, pathTo);
+    }
+    bool rename(const String &pathFrom, const String &pathTo)
+    {
+        return rename(pathFrom.c_str(), pathTo.c_str());
+    }
+
+private:
+    FSImplPtr impl;
+};
+} // namespace fs
+
+using fs::File;
+using fs::FS;
+using fs::SeekCur;
+using fs::SeekEnd;
+using fs::SeekMode;
+using fs::SeekSet;
+
+extern fs::FS SPIFFS;
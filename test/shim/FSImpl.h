@@ -0,0 +1,93 @@
+#pragma once
+
+// Same interfaces as the ESP8266 core, so the file systems of the sources plug in unchanged
+
+#include <memory>
+
+namespace fs
+{
+enum SeekMode
+{
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2
+};
+
+struct FSConfig
+{
+};
+struct FSInfo
+{
+};
+struct FSInfo64
+{
+};
+
+enum OpenMode
+{
+    OM_DEFAULT = 0,
+    OM_CREATE = 1,
+    OM_APPEND = 2,
+    OM_TRUNCATE = 4
+};
+
+enum AccessMode
+{
+    AM_READ = 1,
+    AM_WRITE = 2,
+    AM_RW = AM_READ | AM_WRITE
+};
+
+class FileImpl
+{
+public:
+    virtual ~FileImpl() {}
+    virtual size_t write(const uint8_t *buf, size_t size) = 0;
+    virtual int read(uint8_t *buf, size_t size) = 0;
+    virtual void flush() = 0;
+    virtual bool seek(uint32_t pos, SeekMode mode) = 0;
+    virtual size_t position() const = 0;
+    virtual size_t size() const = 0;
+    virtual bool truncate(uint32_t size) = 0;
+    virtual void close() = 0;
+    virtual const char *name() const = 0;
+    virtual const char *fullName() const = 0;
+    virtual bool isFile() const = 0;
+    virtual bool isDirectory() const = 0;
+};
+typedef std::shared_ptr<FileImpl> FileImplPtr;
+
+class DirImpl
+{
+public:
+    virtual ~DirImpl() {}
+    virtual FileImplPtr openFile(OpenMode openMode, AccessMode accessMode) = 0;
+    virtual const char *fileName() = 0;
+    virtual size_t fileSize() = 0;
+    virtual bool isFile() const = 0;
+    virtual bool isDirectory() const = 0;
+    virtual bool next() = 0;
+    virtual bool rewind() = 0;
+};
+typedef std::shared_ptr<DirImpl> DirImplPtr;
+
+class FSImpl
+{
+public:
+    virtual ~FSImpl() {}
+    virtual bool setConfig(const FSConfig &cfg) = 0;
+    virtual bool begin() = 0;
+    virtual void end() = 0;
+    virtual bool format() = 0;
+    virtual bool info(FSInfo &info) = 0;
+    virtual bool info64(FSInfo64 &info) = 0;
+    virtual FileImplPtr open(const char *path, OpenMode openMode, AccessMode accessMode) = 0;
+    virtual bool exists(const char *path) = 0;
+    virtual DirImplPtr openDir(const char *path) = 0;
+    virtual bool rename(const char *pathFrom, const char *pathTo) = 0;
+    virtual bool remove(const char *path) = 0;
+    virtual bool mkdir(const char *path) = 0;
+    virtual bool rmdir(const char *path) = 0;
+};
+typedef std::shared_ptr<FSImpl> FSImplPtr;
+} // namespace fs
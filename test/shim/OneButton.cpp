@@ -0,0 +1,110 @@
+#include "OneButton.h"
+
+// The level must be stable for debounceMs, measured on millis()
+bool OneButton::debounce(bool value)
+{
+    const unsigned long now = millis();
+    if (lastDebounceLevel == value)
+    {
+        if (now - lastDebounceTime >= (unsigned long)abs(debounceMs))
+        {
+            debouncedLevel = value;
+        }
+    }
+    else
+    {
+        lastDebounceTime = now;
+        lastDebounceLevel = value;
+    }
+    return debouncedLevel;
+}
+
+void OneButton::tick(bool activeLevel)
+{
+    fsm(debounce(activeLevel));
+}
+
+void OneButton::reset()
+{
+    state = INIT;
+    clicks = 0;
+    startTime = millis();
+}
+
+void OneButton::fsm(bool activeLevel)
+{
+    const unsigned long now = millis();
+    const unsigned long waitTime = now - startTime;
+
+    switch (state)
+    {
+    case INIT:
+        if (activeLevel)
+        {
+            state = DOWN;
+            startTime = now;
+            clicks = 0;
+        }
+        break;
+
+    case DOWN:
+        if (!activeLevel)
+        {
+            state = UP;
+            startTime = now;
+        }
+        else if (waitTime > pressMs)
+        {
+            if (longPressStartFunction)
+            {
+                longPressStartFunction(longPressStartParameter);
+            }
+            state = PRESS;
+        }
+        break;
+
+    case UP:
+        clicks++;
+        state = COUNT;
+        break;
+
+    case COUNT:
+        if (activeLevel)
+        {
+            state = DOWN;
+            startTime = now;
+        }
+        else if (waitTime >= clickMs || clicks == maxClicks)
+        {
+            if (clicks == 1 && clickFunction)
+            {
+                clickFunction(clickParameter);
+            }
+            else if (clicks == 2 && doubleClickFunction)
+            {
+                doubleClickFunction(doubleClickParameter);
+            }
+            reset();
+        }
+        break;
+
+    case PRESS:
+        if (!activeLevel)
+        {
+            state = PRESSEND;
+        }
+        else if (longPressIntervalMs == 0 || now - lastDuringLongPressTime >= longPressIntervalMs)
+        {
+            if (duringLongPressFunction)
+            {
+                duringLongPressFunction(duringLongPressParameter);
+            }
+            lastDuringLongPressTime = now;
+        }
+        break;
+
+    case PRESSEND:
+        reset();
+        break;
+    }
+}
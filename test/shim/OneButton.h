@@ -0,0 +1,116 @@
+#pragma once
+
+// Host copy of the OneButton 2.5 state machine, with the same defaults, debounce
+// and callback order, so the simulator reproduces the gesture timings of the pedal.
+// Only the parts used by the pedal are kept.
+
+#include "Arduino.h"
+
+typedef void (*callbackFunction)(void);
+typedef void (*parameterizedCallbackFunction)(void *);
+
+class OneButton
+{
+public:
+    OneButton() {}
+
+    void setDebounceMs(int ms)
+    {
+        debounceMs = ms;
+    }
+    void setClickMs(unsigned int ms)
+    {
+        clickMs = ms;
+    }
+    void setPressMs(unsigned int ms)
+    {
+        pressMs = ms;
+    }
+    void setIdleMs(unsigned int ms)
+    {
+        idleMs = ms;
+    }
+    void setLongPressIntervalMs(unsigned int ms)
+    {
+        longPressIntervalMs = ms;
+    }
+
+    void attachClick(parameterizedCallbackFunction function, void *parameter)
+    {
+        clickFunction = function;
+        clickParameter = parameter;
+        maxClicks = max(maxClicks, 1);
+    }
+    void attachDoubleClick(parameterizedCallbackFunction function, void *parameter)
+    {
+        doubleClickFunction = function;
+        doubleClickParameter = parameter;
+        maxClicks = max(maxClicks, 2);
+    }
+    void attachLongPressStart(parameterizedCallbackFunction function, void *parameter)
+    {
+        longPressStartFunction = function;
+        longPressStartParameter = parameter;
+    }
+    void attachDuringLongPress(parameterizedCallbackFunction function, void *parameter)
+    {
+        duringLongPressFunction = function;
+        duringLongPressParameter = parameter;
+    }
+
+    // Advance the state machine with the active (pressed) level of the input
+    void tick(bool activeLevel);
+    void reset();
+
+    bool isIdle() const
+    {
+        return state == INIT;
+    }
+    bool isLongPressed() const
+    {
+        return state == PRESS;
+    }
+    unsigned long getPressedMs()
+    {
+        return millis() - startTime;
+    }
+
+private:
+    enum State
+    {
+        INIT,
+        DOWN,
+        UP,
+        COUNT,
+        PRESS,
+        PRESSEND
+    };
+
+    int debounceMs = 50;
+    unsigned int clickMs = 400;
+    unsigned int pressMs = 800;
+    unsigned int idleMs = 1000;
+    unsigned int longPressIntervalMs = 0;
+    int maxClicks = 1;
+
+    parameterizedCallbackFunction clickFunction = nullptr;
+    void *clickParameter = nullptr;
+    parameterizedCallbackFunction doubleClickFunction = nullptr;
+    void *doubleClickParameter = nullptr;
+    parameterizedCallbackFunction longPressStartFunction = nullptr;
+    void *longPressStartParameter = nullptr;
+    parameterizedCallbackFunction duringLongPressFunction = nullptr;
+    void *duringLongPressParameter = nullptr;
+
+    State state = INIT;
+    unsigned long startTime = 0;
+    int clicks = 0;
+    unsigned long lastDuringLongPressTime = 0;
+
+    bool debouncedLevel = false;
+    bool lastDebounceLevel = false;
+    unsigned long lastDebounceTime = 0;
+
+    bool debounce(bool value);
+    void fsm(bool activeLevel);
+};
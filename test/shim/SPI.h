@@ -0,0 +1,30 @@
+#pragma once
+
+// SPI bus reading the simulated 74HC165 chain, the transfer time is added to the clock
+
+#include "Arduino.h"
+
+#define SPI_MODE0 0
+
+struct SPISettings
+{
+    SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) : clock(clock) {}
+    uint32_t clock;
+};
+
+class SPIClass
+{
+public:
+    void begin() {}
+    void beginTransaction(SPISettings settings)
+    {
+        clock = settings.clock;
+    }
+    void endTransaction() {}
+    void transfer(void *buffer, uint16_t size);
+
+private:
+    uint32_t clock = 1000000;
+};
+
+extern SPIClass SPI;
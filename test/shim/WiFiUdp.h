@@ -0,0 +1,31 @@
+#pragma once
+
+// Datagrams are dropped, the network MIDI port isn't simulated
+
+#include "Arduino.h"
+
+class WiFiUDP : public Print
+{
+public:
+    uint8_t begin(uint16_t port)
+    {
+        return 1;
+    }
+    int beginPacket(const char *host, uint16_t port)
+    {
+        return 1;
+    }
+    int endPacket()
+    {
+        return 1;
+    }
+    size_t write(uint8_t byte) override
+    {
+        return 1;
+    }
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        return size;
+    }
+    using Print::write;
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Arduino.h"
+
+void esp_schedule();
+
+// Runs the light sleep requested with wifi_fpm_do_sleep(), then waits in virtual time
+// while blocked() is true, at most timeoutMs
+template <typename T>
+void esp_delay(uint32_t timeoutMs, T &&blocked)
+{
+    const uint64_t end = sim::nowUs() + timeoutMs * 1000ULL;
+    sim::runRequestedSleep();
+    while (blocked() && sim::nowUs() < end)
+    {
+        sim::advanceUs(100);
+    }
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdint.h>
+
+#define GPIO_ID_PIN(n) (n)
+
+typedef enum
+{
+    GPIO_PIN_INTR_DISABLE = 0,
+    GPIO_PIN_INTR_LOLEVEL = 4,
+    GPIO_PIN_INTR_HILEVEL = 5
+} GPIO_INT_TYPE;
+
+// A LOW level on the pin ends the light sleep
+void gpio_pin_wakeup_enable(uint32_t pin, GPIO_INT_TYPE type);
+void gpio_pin_wakeup_disable();
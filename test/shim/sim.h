@@ -0,0 +1,47 @@
+#pragma once
+
+// Simulator controls of the host shim: virtual clock, scheduled GPIO levels and the
+// shift register inputs. Everything is deterministic, a replay only depends on the
+// events scheduled and on how the clock is advanced.
+
+namespace sim
+{
+// Virtual time since boot, including the light sleeps that millis() and micros() don't count
+uint64_t nowUs();
+
+// Move the clock forward, applying the pin events scheduled in the interval in order
+void advanceUs(uint64_t us);
+
+// Change an input level now or at an absolute virtual time
+void setPin(uint8_t pin, int level);
+void schedulePin(uint64_t atUs, uint8_t pin, int level);
+int pinLevel(uint8_t pin);
+
+// Parallel inputs of the 74HC165 chain read by SPI.transfer(), bit clear is pressed
+extern uint8_t shiftRegister[8];
+// Value returned by analogRead()
+extern int analogValue;
+
+// Access point in range of the station, none when ssid is null
+struct AccessPoint
+{
+    const char *ssid = nullptr;
+    const char *password = nullptr;
+    uint8_t bssid[6] = {0};
+    int32_t channel = 1;
+};
+extern AccessPoint accessPoint;
+
+// Duration of the connection phases of the ESP8266 station
+const uint64_t WIFI_SCAN_US = 2200000;     // active scan of all the channels
+const uint64_t WIFI_ASSOCIATE_US = 150000; // authentication, association and key handshake
+const uint64_t WIFI_DHCP_US = 800000;      // DHCP lease, skipped with a static address
+
+// Forced light sleep requested with wifi_fpm_do_sleep(), run when the code yields: the
+// CPU clock stops until the timeout, or until the wake pin goes LOW
+void runRequestedSleep();
+
+// Power on: the clock restarts at 0 and the pending pin events, the bytes recorded on
+// the UARTs and the Wi-Fi connection are dropped. The file system is kept, like the flash
+void reboot();
+} // namespace sim
@@ -0,0 +1,26 @@
+#pragma once
+
+// Forced light sleep of the SDK: the sleep itself runs when the code yields (see
+// esp_delay() in coredecls.h). The RTC keeps counting in virtual time while the CPU
+// clock, and so millis() and micros(), stop.
+
+#include <stdint.h>
+
+enum sleep_type
+{
+    NONE_SLEEP_T = 0,
+    LIGHT_SLEEP_T,
+    MODEM_SLEEP_T
+};
+
+typedef void (*fpm_wakeup_cb)(void);
+
+void wifi_fpm_set_sleep_type(sleep_type type);
+void wifi_fpm_open();
+void wifi_fpm_close();
+void wifi_fpm_set_wakeup_cb(fpm_wakeup_cb cb);
+int8_t wifi_fpm_do_sleep(uint32_t us);
+
+uint32_t system_get_rtc_time();
+// RTC period in 1/4096 us
+uint32_t system_rtc_clock_cali_proc();
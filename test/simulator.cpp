@@ -0,0 +1,462 @@
+// Replay simulator: runs setup() and loop() of main.cpp on the host shim (test/shim) with a
+// virtual clock, drives the footswitch pins and records every byte sent on MIDI_OUT_Serial
+// with the time it starts on the wire.
+//
+//   simulator                 run the built-in scenarios and assert output and latency
+//   simulator <file.trace>    replay a recorded trace and print the MIDI bytes sent
+//
+// A trace has one event per line, "<ms> <button> down|up", lines starting with # are ignored.
+
+#include "main.cpp"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+// Virtual time spent in each loop() pass
+const uint64_t LOOP_US = 200;
+// Sent at most two passes (UP then COUNT) and one millisecond (millis() resolution) after the expected time
+const uint64_t LATENCY_SLACK_US = 2 * LOOP_US + 1000;
+// After a light sleep the millis() ticks aren't aligned with the virtual clock anymore
+const uint64_t EARLY_SLACK_US = 1000;
+
+// OneButton defaults and the timings set by applyButtonTimings()
+const uint64_t DEBOUNCE_MS = 50;
+const uint64_t PRESS_MS = 800;
+const uint64_t CLICK_MS = 60;
+const uint64_t DOUBLE_CLICK_MS = 400;
+
+int failures = 0;
+// Virtual time of the boots before the last one
+uint64_t previousBootsUs = 0;
+
+#define CHECK(condition, message)                                                                                                \
+    do                                                                                                                           \
+    {                                                                                                                            \
+        if (!(condition))                                                                                                        \
+        {                                                                                                                        \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, message);                                                             \
+            failures++;                                                                                                          \
+        }                                                                                                                        \
+    } while (0)
+
+void runUntilUs(uint64_t end)
+{
+    while (sim::nowUs() < end)
+    {
+        loop();
+        sim::advanceUs(LOOP_US);
+    }
+}
+
+void runForMs(uint64_t ms)
+{
+    runUntilUs(sim::nowUs() + ms * 1000);
+}
+
+// Footswitches are active LOW
+void scheduleButton(uint64_t atUs, uint8_t button, bool down)
+{
+    sim::schedulePin(atUs, buttonPins[button - 1], down ? LOW : HIGH);
+}
+
+void printSent(size_t from)
+{
+    for (size_t i = from; i < MIDI_OUT_Serial.sent.size(); i++)
+    {
+        printf("%llu %02X\n", (unsigned long long)MIDI_OUT_Serial.sent[i].us, MIDI_OUT_Serial.sent[i].byte);
+    }
+}
+
+// Bytes sent from index from, as hex
+std::string sentBytes(size_t from)
+{
+    std::string bytes;
+    char hex[4];
+    for (size_t i = from; i < MIDI_OUT_Serial.sent.size(); i++)
+    {
+        snprintf(hex, sizeof(hex), i > from ? " %02X" : "%02X", MIDI_OUT_Serial.sent[i].byte);
+        bytes += hex;
+    }
+    return bytes;
+}
+
+bool sentWithin(size_t index, uint64_t expectedUs)
+{
+    if (index >= MIDI_OUT_Serial.sent.size())
+    {
+        printf("  no byte %zu, expected at %llu us\n", index, (unsigned long long)expectedUs);
+        return false;
+    }
+    const uint64_t us = MIDI_OUT_Serial.sent[index].us;
+    if (us + EARLY_SLACK_US < expectedUs || us > expectedUs + LATENCY_SLACK_US)
+    {
+        printf("  byte %zu sent at %llu us, expected %llu us\n", index, (unsigned long long)us, (unsigned long long)expectedUs);
+        return false;
+    }
+    return true;
+}
+
+// Leave enough time between scenarios for OneButton and the journal to be idle
+void settle()
+{
+    runForMs(2000);
+}
+
+void testPush()
+{
+    printf("push\n");
+    const size_t from = MIDI_OUT_Serial.sent.size();
+    const uint64_t press = sim::nowUs();
+    scheduleButton(press, 1, true);
+    scheduleButton(press + 100000, 1, false);
+    runForMs(1000);
+
+    // Click: release debounced, then no second press for the click time
+    CHECK(sentWithin(from, press + 100000 + (DEBOUNCE_MS + CLICK_MS) * 1000), "push latency");
+    CHECK(sentBytes(from) == "B0 50 7F 50 00", "push bytes (TRK P/S with running status)");
+    printSent(from);
+    settle();
+}
+
+void testHold()
+{
+    printf("hold\n");
+    const size_t from = MIDI_OUT_Serial.sent.size();
+    const uint64_t press = sim::nowUs();
+    scheduleButton(press, 1, true);
+    scheduleButton(press + 1500000, 1, false);
+    runForMs(2000);
+
+    // Long press start, once: the button doesn't repeat on hold
+    CHECK(sentWithin(from, press + (DEBOUNCE_MS + PRESS_MS) * 1000), "hold latency");
+    CHECK(sentBytes(from).substr(3) == "51 7F 51 00", "hold bytes (TRK CLR)");
+    printSent(from);
+    settle();
+}
+
+void testHoldRepeat()
+{
+    printf("hold repeat\n");
+    const size_t from = MIDI_OUT_Serial.sent.size();
+    const int32_t value = midiButtons[4].var.value;
+    const uint64_t press = sim::nowUs();
+    scheduleButton(press, 5, true);
+    scheduleButton(press + 1500000, 5, false);
+    runForMs(2500);
+
+    // Long press, then every LONG_PRESS_INTERVAL_MS until the release is debounced
+    const uint64_t first = press + (DEBOUNCE_MS + PRESS_MS) * 1000;
+    const uint64_t last = press + 1500000 + DEBOUNCE_MS * 1000;
+    int repeats = 0;
+    for (uint64_t at = first; at < last; at += LONG_PRESS_INTERVAL_MS * 1000)
+    {
+        // PATTERN INC: CC 85 <VAR> and CC 85 127, 5 bytes, then 4 with running status
+        CHECK(sentWithin(from + (repeats == 0 ? 0 : 5 + (repeats - 1) * 4), at), "hold repeat latency");
+        repeats++;
+    }
+    CHECK(repeats == 3, "hold repeats");
+    CHECK(midiButtons[4].var.value == value + repeats, "VAR incremented on each repeat");
+    printSent(from);
+    settle();
+}
+
+void testDoublePush()
+{
+    printf("double push\n");
+    const size_t from = MIDI_OUT_Serial.sent.size();
+    const int32_t value = midiButtons[4].var.value;
+    const uint64_t press = sim::nowUs();
+    scheduleButton(press, 5, true);
+    scheduleButton(press + 100000, 5, false);
+    scheduleButton(press + 200000, 5, true);
+    scheduleButton(press + 300000, 5, false);
+    runForMs(1000);
+
+    // The second click ends the gesture at once
+    CHECK(sentWithin(from, press + 300000 + DEBOUNCE_MS * 1000), "double push latency");
+    CHECK(midiButtons[4].var.value == value - 1, "VAR decremented by the double push");
+    printSent(from);
+    settle();
+}
+
+void testPushWithDoublePush()
+{
+    printf("push with double push\n");
+    const size_t from = MIDI_OUT_Serial.sent.size();
+    const uint64_t press = sim::nowUs();
+    scheduleButton(press, 5, true);
+    scheduleButton(press + 100000, 5, false);
+    runForMs(1000);
+
+    // A button with double push commands waits for a second click
+    CHECK(sentWithin(from, press + 100000 + (DEBOUNCE_MS + DOUBLE_CLICK_MS) * 1000), "push latency with double push");
+    printSent(from);
+    settle();
+}
+
+// A push during a SysEx dump longer than the port buffer is held back and sent whole
+// after the F7, with its status byte
+void testPushDuringSysex()
+{
+    printf("push during SysEx\n");
+    File file = storage.open("/sysex9.syx", "w");
+    file.write(0xF0);
+    for (uint16_t i = 0; i < 1998; i++)
+    {
+        file.write(i & 0x7F);
+    }
+    file.write(0xF7);
+    file.close();
+
+    const size_t from = MIDI_OUT_Serial.sent.size();
+    const uint32_t dropped = midiPorts[0].bytesDropped;
+    CHECK(startSysexStream(9, 0), "SysEx dump started");
+    const uint64_t press = sim::nowUs();
+    scheduleButton(press, 1, true);
+    scheduleButton(press + 100000, 1, false);
+    runForMs(1500);
+
+    CHECK(!sysexStream.active, "SysEx dump sent");
+    CHECK(midiPorts[0].bytesDropped == dropped, "nothing dropped");
+    CHECK(sentBytes(from + 2000) == "B0 50 7F 50 00", "push after the F7 (TRK P/S with its status byte)");
+    printSent(from + 2000);
+    storage.remove("/sysex9.syx");
+    settle();
+}
+
+// PUT /config with If-Match only applies while the configuration still has the hash the
+// client read: of two provisioners starting from the same hash, the second one gets 412
+void testConditionalPut()
+{
+    printf("conditional PUT /config\n");
+    const AsyncWebServerResponse current = server.request(HTTP_GET, "/config");
+    const String etag = current.headers.count("ETag") ? current.headers.at("ETag") : String();
+    CHECK(current.code == 200 && etag == "W/\"" + configHashString() + "\"", "GET /config with the hash as ETag");
+
+    String first = current.content;
+    first.replace("CC 1 83 127,CC 1 83 0", "PC 1 5 0");
+    String second = current.content;
+    second.replace("CC 1 83 127,CC 1 83 0", "PC 1 6 0");
+
+    CHECK(server.request(HTTP_PUT, "/config", first, {{"If-Match", "\"00000000\""}}).code == 412, "412 for another hash");
+    CHECK(midiButtons[2].push.toString() == "CC 1 83 127,CC 1 83 0", "nothing applied on 412");
+    CHECK(server.request(HTTP_PUT, "/config", first, {{"If-Match", etag}}).code == 204, "204 with the current ETag");
+    runForMs(100);
+    CHECK(server.request(HTTP_PUT, "/config", second, {{"If-Match", etag}}).code == 412, "412 for the second provisioner");
+    CHECK(midiButtons[2].push.toString() == "PC 1 5 0", "first configuration kept");
+    CHECK(server.request(HTTP_PUT, "/config", first, {{"If-Match", configHashString()}}).code == 304, "304 with the mDNS hash");
+    CHECK(server.request(HTTP_PUT, "/config", current.content).code == 204, "unconditional PUT");
+    settle();
+}
+
+void testStaticFiles()
+{
+    printf("static files\n");
+    File page = storage.open(WEB_ROOT "/index.html.gz", "w");
+    page.print("page");
+    page.close();
+    File sysex = storage.open("/sysex1.syx", "w");
+    sysex.write(0xF0);
+    sysex.write(0xF7);
+    sysex.close();
+
+    const AsyncWebServerResponse index = server.request(HTTP_GET, "/index.html");
+    CHECK(index.code == 200 && index.content == "page", "web asset sent from " WEB_ROOT);
+    CHECK(storage.exists("/journal.log") && server.request(HTTP_GET, "/journal.log").code == 404, "journal not served");
+    CHECK(storage.exists(WIFI_CACHE_PATH) && server.request(HTTP_GET, WIFI_CACHE_PATH).content.startsWith("{"), "Wi-Fi cache not served");
+    CHECK(server.request(HTTP_GET, "/sysex1.syx").code == 404, "SysEx dump not served");
+    storage.remove(WEB_ROOT "/index.html.gz");
+    storage.remove("/sysex1.syx");
+}
+
+void testPerformanceMode()
+{
+    printf("performance mode\n");
+    const unsigned routes = server.routes;
+    const size_t handlers = server.handlers.size();
+    enterPerformanceMode();
+    runForMs(100);
+    leavePerformanceMode();
+    runForMs(100);
+
+    // Routes, handlers and networks are registered once, at boot
+    CHECK(routes > 0 && server.routes == routes, "routes registered once");
+    CHECK(handlers == 1 && server.handlers.size() == handlers, "connection limit handler registered once");
+    CHECK(wifiMulti.networks.size() == 2, "networks added once");
+    settle();
+}
+
+// Holding the first and last buttons toggles the performance mode without sending their
+// commands: with the defaults the hold of button 1 is TRK CLR, which would clear the looper track
+void testPerformanceGesture()
+{
+    printf("performance mode gesture\n");
+    const size_t from = MIDI_OUT_Serial.sent.size();
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        const uint64_t press = sim::nowUs();
+        scheduleButton(press, 1, true);
+        scheduleButton(press + 20000, BUTTON_COUNT, true);
+        scheduleButton(press + (PERFORMANCE_GESTURE_MS + 1000) * 1000, 1, false);
+        scheduleButton(press + (PERFORMANCE_GESTURE_MS + 1100) * 1000, BUTTON_COUNT, false);
+        runForMs(PERFORMANCE_GESTURE_MS + 2000);
+        CHECK(performanceMode == (i == 0), i == 0 ? "performance mode entered" : "performance mode left");
+        settle();
+    }
+    CHECK(sentBytes(from).empty(), "no MIDI sent by the gesture");
+    printSent(from);
+
+    // The buttons work again once released
+    const uint64_t press = sim::nowUs();
+    scheduleButton(press, BUTTON_COUNT, true);
+    scheduleButton(press + 100000, BUTTON_COUNT, false);
+    runForMs(1000);
+    CHECK(sentBytes(from) == "B0 56 7F 56 00", "push after the gesture (MEM INC)");
+    settle();
+}
+
+#ifdef LIGHT_SLEEP
+// Idle in performance mode the pedal sleeps. millis() stops while sleeping, so the press
+// seen after a wake isn't debounced yet: the pedal must stay awake until the push is sent
+void testLightSleep()
+{
+    printf("light sleep\n");
+    enterPerformanceMode();
+    runForMs(LIGHT_SLEEP_IDLE_MS + 1000);
+    CHECK(lightSleep.slices > 0, "sleeping when idle");
+
+    const size_t from = MIDI_OUT_Serial.sent.size();
+    const uint64_t press = sim::nowUs();
+    scheduleButton(press, 1, true);
+    scheduleButton(press + 100000, 1, false);
+    runForMs(200);
+    const uint32_t slices = lightSleep.slices;
+    runForMs(800);
+
+    // Seen at most one slice late, then awake: the release is timed as usual
+    CHECK(sentWithin(from, press + 100000 + (DEBOUNCE_MS + CLICK_MS) * 1000), "push latency after a wake");
+    CHECK(sentBytes(from) == "B0 50 7F 50 00", "push bytes after a wake");
+    CHECK(lightSleep.slices == slices, "awake after the gesture until the idle time is over");
+    printSent(from);
+
+    runForMs(LIGHT_SLEEP_IDLE_MS + 1000);
+    CHECK(lightSleep.slices > slices, "sleeping again when idle");
+    leavePerformanceMode();
+    settle();
+}
+#endif
+
+// Fresh device: no cached access point, the known networks are scanned for
+void testFirstBoot(const WiFiTiming &timing)
+{
+    printf("first boot: scan %lu ms, ready %lu ms\n", timing.scanMs, timing.readyMs);
+    CHECK(!timing.direct && timing.directMs == 0, "no direct connection without a cache");
+    CHECK(timing.scanMs >= (sim::WIFI_SCAN_US + sim::WIFI_ASSOCIATE_US + sim::WIFI_DHCP_US) / 1000, "connected after a scan");
+    CHECK(serverStarted, "server started");
+    WiFiCache cache;
+    CHECK(loadWiFiCache(storage, cache) && cache.network == 1 && cache.channel == sim::accessPoint.channel, "access point cached");
+}
+
+// Power cycle: the shim starts over, the flash keeps the Wi-Fi cache and the journal
+void testReboot(const WiFiTiming &firstBoot)
+{
+    previousBootsUs += sim::nowUs();
+    sim::reboot();
+    wifiMulti = ESP8266WiFiMulti();
+    server = AsyncWebServer(80);
+    setup();
+
+    printf("second boot: direct %lu ms, ready %lu ms\n", wifiTiming.directMs, wifiTiming.readyMs);
+    CHECK(wifiTiming.direct && wifiTiming.scanMs == 0, "direct connection to the cached access point");
+    CHECK(wifiTiming.readyMs + sim::WIFI_SCAN_US / 1000 <= firstBoot.readyMs, "ready sooner than after a scan");
+    settle();
+}
+
+// "<ms> <button> down|up" per line
+bool replay(const char *path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        fprintf(stderr, "Can't open %s\n", path);
+        return false;
+    }
+
+    const uint64_t start = sim::nowUs();
+    uint64_t end = start;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        std::istringstream fields(line);
+        uint64_t ms;
+        unsigned button;
+        std::string level;
+        if (!(fields >> ms >> button >> level) || button < 1 || button > BUTTON_COUNT || (level != "down" && level != "up"))
+        {
+            fprintf(stderr, "Invalid trace line: %s\n", line.c_str());
+            return false;
+        }
+        scheduleButton(start + ms * 1000, button, level == "down");
+        end = max(end, start + ms * 1000);
+    }
+
+    const size_t from = MIDI_OUT_Serial.sent.size();
+    runUntilUs(end + 2000000);
+    // Times relative to the start of the trace
+    for (size_t i = from; i < MIDI_OUT_Serial.sent.size(); i++)
+    {
+        printf("%llu %02X\n", (unsigned long long)(MIDI_OUT_Serial.sent[i].us - start), MIDI_OUT_Serial.sent[i].byte);
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    const auto wallStart = std::chrono::steady_clock::now();
+
+    // AP_2 in range, on channel 6
+    sim::accessPoint.ssid = AP_2;
+    sim::accessPoint.password = PWD_2;
+    sim::accessPoint.channel = 6;
+    memcpy(sim::accessPoint.bssid, "\x02\x11\x22\x33\x44\x55", sizeof(sim::accessPoint.bssid));
+
+    setup();
+    const WiFiTiming firstBoot = wifiTiming;
+    settle();
+
+    if (argc > 1)
+    {
+        return replay(argv[1]) ? 0 : 1;
+    }
+
+    testFirstBoot(firstBoot);
+    testPush();
+    testHold();
+    testHoldRepeat();
+    testDoublePush();
+    testPushWithDoublePush();
+    testPushDuringSysex();
+    testConditionalPut();
+    testStaticFiles();
+    testPerformanceMode();
+    testPerformanceGesture();
+#ifdef LIGHT_SLEEP
+    testLightSleep();
+#endif
+    testReboot(firstBoot);
+
+    // Replays must run much faster than the pedal
+    const double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    const double simulatedSeconds = (previousBootsUs + sim::nowUs()) / 1e6;
+    const double speedup = simulatedSeconds / max(wallSeconds, 1e-6);
+    fprintf(stderr, "%.1f s simulated in %.3f s (%.0fx)\n", simulatedSeconds, wallSeconds, speedup);
+    CHECK(speedup > 10, "faster than real time");
+
+    printf(failures ? "%d failures\n" : "OK\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,43 @@
+#!/usr/bin/env python3
+"""Compress the web interface sources (web/) into the file system image folder (data/www/).
+
+The web server sends <file>.gz with Content-Encoding: gzip when <file> is requested,
+so only the compressed files are stored. Only www/ is served, the other files of the
+file system (configuration journal, Wi-Fi cache, SysEx dumps) can't be downloaded.
+Run it after changing anything in web/, then upload the data folder. The output is
+reproducible (no timestamp in the headers).
+"""
+
+import gzip
+import os
+import sys
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+SOURCE = os.path.join(ROOT, "web")
+TARGET = os.path.join(ROOT, "data", "www")
+
+
+def main():
+    os.makedirs(TARGET, exist_ok=True)
+    total_source = 0
+    total_target = 0
+    for name in sorted(os.listdir(SOURCE)):
+        with open(os.path.join(SOURCE, name), "rb") as file:
+            data = file.read()
+        compressed = gzip.compress(data, compresslevel=9, mtime=0)
+        with open(os.path.join(TARGET, name + ".gz"), "wb") as file:
+            file.write(compressed)
+
+        # An uncompressed copy would be served instead of the .gz one
+        if os.path.exists(os.path.join(TARGET, name)):
+            os.remove(os.path.join(TARGET, name))
+
+        total_source += len(data)
+        total_target += len(compressed)
+        print("%-16s %7d -> %6d bytes" % (name, len(data), len(compressed)))
+    print("%-16s %7d -> %6d bytes" % ("total", total_source, total_target))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""Configure and monitor a MIDI pedal over its USB serial port (SERIAL_CONFIG_PROTOCOL).
+
+Frames are 0x7E, payload length (2 bytes LE), opcode, payload and the CRC-16/CCITT
+(0xFFFF start) of length, opcode and payload (2 bytes LE), see src/serial_protocol.h.
+The port can be a pseudo terminal, e.g. one end of `socat -d -d pty,raw,echo=0 pty,raw,echo=0`.
+
+  pedal_serial.py --port /dev/ttyUSB0 ping
+  pedal_serial.py get config.json
+  pedal_serial.py put config.json
+  pedal_serial.py trigger 5 hold
+  pedal_serial.py monitor
+
+Requires pyserial: pip install pyserial
+"""
+
+import argparse
+import struct
+import sys
+import time
+
+SYNC = 0x7E
+PING = 0x01
+GET_CONFIG = 0x02
+PUT_CONFIG = 0x03
+TRIGGER = 0x04
+MONITOR = 0x05
+REPLY = 0x80
+MIDI_EVENT = 0xC0
+VAR_EVENT = 0xC1
+ERROR = 0xFF
+
+GESTURES = {"push": 0, "hold": 1, "double": 2}
+PORT_NAMES = ["serial1", "uart0", "network"]
+
+
+def crc16(data, crc=0xFFFF):
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021 if crc & 0x8000 else crc << 1) & 0xFFFF
+    return crc
+
+
+def encode(opcode, payload=b""):
+    body = struct.pack("<HB", len(payload), opcode) + payload
+    return bytes([SYNC]) + body + struct.pack("<H", crc16(body))
+
+
+class Pedal:
+    def __init__(self, port, baud):
+        import serial
+
+        self.serial = serial.Serial(port, baud, timeout=0.1)
+
+    def send(self, opcode, payload=b""):
+        self.serial.write(encode(opcode, payload))
+
+    def read_frame(self, timeout):
+        """Return (opcode, payload) of the next valid frame, None after timeout seconds."""
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            if self.serial.read(1) != bytes([SYNC]):
+                continue
+            header = self.serial.read(3)
+            if len(header) < 3:
+                continue
+            length, opcode = struct.unpack("<HB", header)
+            rest = self.serial.read(length + 2)
+            if len(rest) < length + 2:
+                continue
+            payload, crc = rest[:length], struct.unpack("<H", rest[length:])[0]
+            if crc16(header + payload) == crc:
+                return opcode, payload
+        return None
+
+    def request(self, opcode, payload=b"", timeout=3.0):
+        """Send a request and return the payload of its reply, events received meanwhile are skipped."""
+        self.send(opcode, payload)
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            frame = self.read_frame(deadline - time.monotonic())
+            if frame is None:
+                break
+            if frame[0] == opcode | REPLY:
+                return frame[1]
+            if frame[0] == ERROR:
+                raise RuntimeError(frame[1].decode(errors="replace"))
+        raise TimeoutError("no reply from the pedal")
+
+
+def print_event(opcode, payload):
+    if opcode == MIDI_EVENT:
+        ports = ",".join(name for i, name in enumerate(PORT_NAMES) if payload[0] & (1 << i))
+        print("MIDI %s -> %s" % (payload[1:].hex(" "), ports or "-"))
+    elif opcode == VAR_EVENT:
+        button, value = struct.unpack("<Bi", payload)
+        print("VAR button %d = %d" % (button, value))
+    elif opcode == ERROR:
+        print("error: %s" % payload.decode(errors="replace"))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", default="/dev/ttyUSB0", help="serial port or pseudo terminal")
+    parser.add_argument("--baud", type=int, default=115200, help="SERIAL_PROTOCOL_BAUD of the pedal")
+    commands = parser.add_subparsers(dest="command", required=True)
+    commands.add_parser("ping", help="print the protocol version and the number of buttons")
+    get = commands.add_parser("get", help="print or save the configuration document")
+    get.add_argument("file", nargs="?", help="output file, stdout if omitted")
+    put = commands.add_parser("put", help="replace the configuration, as PUT /config")
+    put.add_argument("file", help="configuration file, as returned by get")
+    trigger = commands.add_parser("trigger", help="run the commands of a button gesture")
+    trigger.add_argument("button", type=int, help="button number, from 1")
+    trigger.add_argument("gesture", choices=sorted(GESTURES), nargs="?", default="push")
+    commands.add_parser("monitor", help="print the MIDI messages and VAR changes until Ctrl-C")
+    args = parser.parse_args()
+
+    pedal = Pedal(args.port, args.baud)
+    if args.command == "ping":
+        version, buttons = struct.unpack("<BB", pedal.request(PING))
+        print("Protocol version %d, %d buttons" % (version, buttons))
+    elif args.command == "get":
+        document = pedal.request(GET_CONFIG)
+        if args.file:
+            with open(args.file, "wb") as file:
+                file.write(document)
+        else:
+            print(document.decode())
+    elif args.command == "put":
+        with open(args.file, "rb") as file:
+            reply = pedal.request(PUT_CONFIG, file.read())
+        status = struct.unpack("<H", reply[:2])[0]
+        if status == 204:
+            print("Saved")
+        elif status == 304:
+            print("No changes")
+        else:
+            print(reply[2:].decode(errors="replace"))
+            return 1
+    elif args.command == "trigger":
+        pedal.request(TRIGGER, bytes([args.button, GESTURES[args.gesture]]))
+    elif args.command == "monitor":
+        pedal.request(MONITOR, b"\x01")
+        try:
+            while True:
+                frame = pedal.read_frame(1.0)
+                if frame is not None:
+                    print_event(*frame)
+        except KeyboardInterrupt:
+            pedal.request(MONITOR, b"\x00")
+    return 0
+
+
+if __name__ == "__main__":
+    try:
+        sys.exit(main())
+    except (RuntimeError, TimeoutError) as error:
+        print(error)
+        sys.exit(1)
@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+"""Send a configuration to every MIDI pedal on the network that doesn't have it yet.
+
+The pedals are found with mDNS (midi-pedal-*._http._tcp.local), each one publishes the
+FNV-1a hash of its GET /config document without the VAR values in the "config" TXT
+record: the values change while the pedal is played. The configuration file is rendered
+the way the pedal prints it for the hash and hashed, only the pedals with another hash
+get a PUT /config. A pedal that already has the configuration answers 304 anyway,
+so a command list written differently in the file costs a request, not a flash write.
+
+The PUT is conditional: it carries the hash seen at discovery (or in the ETag of
+GET /config with --host) in If-Match, and a pedal whose configuration changed since
+answers 412 instead of overwriting the change. Run the script again to update it.
+
+Requires python-zeroconf: pip install zeroconf
+"""
+
+import argparse
+import json
+import sys
+import time
+import urllib.error
+import urllib.request
+
+SERVICE_TYPE = "_http._tcp.local."
+NAME_PREFIX = "midi-pedal-"
+
+
+def fnv1a(data):
+    value = 2166136261
+    for byte in data:
+        value = ((value ^ byte) * 16777619) & 0xFFFFFFFF
+    return "%08x" % value
+
+
+def render(config):
+    """Render a configuration the same way as configDocumentHash() on the pedal, which
+    prints it with printConfigDocument() without the VAR values."""
+    buttons = []
+    for button in config["buttons"]:
+        var = button.get("var", {})
+        buttons.append(
+            '{"push":"%s","hold":"%s","doublePush":"%s","repeatOnHold":%s,'
+            '"var":{"min":%d,"max":%d,"step":%d}}'
+            % (
+                button.get("push", ""),
+                button.get("hold", ""),
+                button.get("doublePush", ""),
+                "true" if button.get("repeatOnHold", False) else "false",
+                var.get("min", 0),
+                var.get("max", 127),
+                var.get("step", 1),
+            )
+        )
+    return ('{"buttons":[' + ",".join(buttons) + "]}").encode()
+
+
+def discover(timeout):
+    """Return {host: config hash} for the pedals answering within timeout seconds, the host
+    has a :port suffix when the service isn't on port 80."""
+    from zeroconf import ServiceBrowser, Zeroconf
+
+    found = {}
+
+    class Listener:
+        def add_service(self, zc, type_, name):
+            if not name.startswith(NAME_PREFIX):
+                return
+            info = zc.get_service_info(type_, name)
+            if info is None:
+                return
+            host = info.server.rstrip(".") + ("" if info.port == 80 else ":%d" % info.port)
+            found[host] = (info.properties.get(b"config") or b"").decode()
+
+        def update_service(self, zc, type_, name):
+            self.add_service(zc, type_, name)
+
+        def remove_service(self, zc, type_, name):
+            pass
+
+    zeroconf = Zeroconf()
+    try:
+        ServiceBrowser(zeroconf, SERVICE_TYPE, Listener())
+        time.sleep(timeout)
+    finally:
+        zeroconf.close()
+    return found
+
+
+def get_hash(host):
+    """Configuration hash of a pedal, from the ETag of GET /config (W/"<hash>")."""
+    with urllib.request.urlopen("http://%s/config" % host, timeout=10) as response:
+        return (response.headers.get("ETag") or "").replace("W/", "").strip('"')
+
+
+def put_config(host, body, current):
+    """PUT /config while the pedal still has the current hash, returns the HTTP status."""
+    request = urllib.request.Request("http://%s/config" % host, data=body, method="PUT")
+    request.add_header("Content-Type", "application/json")
+    request.add_header("If-Match", '"%s"' % current)
+    try:
+        with urllib.request.urlopen(request, timeout=10) as response:
+            return response.status
+    except urllib.error.HTTPError as error:
+        return error.code
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("config", help="configuration file, as returned by GET /config")
+    parser.add_argument("--host", action="append", help="pedal to update, skips discovery (repeatable)")
+    parser.add_argument("--timeout", type=float, default=3.0, help="discovery time in seconds")
+    parser.add_argument("--dry-run", action="store_true", help="only list the pedals that would be updated")
+    args = parser.parse_args()
+
+    with open(args.config, "rb") as file:
+        body = file.read()
+
+    pedals = {host: "" for host in args.host} if args.host else discover(args.timeout)
+    if not pedals:
+        print("No pedal found")
+        return 1
+    return 1 if provision(pedals, body, args.dry_run) else 0
+
+
+def provision(pedals, body, dry_run=False):
+    """Update the pedals of {host: config hash} that don't have the configuration body, an
+    empty hash is read from the pedal. Returns the number of pedals that failed."""
+    expected = fnv1a(render(json.loads(body)))
+    failed = 0
+    for host, current in sorted(pedals.items()):
+        try:
+            current = current or get_hash(host)
+        except (urllib.error.URLError, OSError) as error:
+            print("%s: failed, %s" % (host, error))
+            failed += 1
+            continue
+        if current == expected:
+            print("%s: up to date (%s)" % (host, current))
+            continue
+        if dry_run:
+            print("%s: would update %s -> %s" % (host, current, expected))
+            continue
+        status = put_config(host, body, current)
+        if status == 204:
+            print("%s: updated %s -> %s" % (host, current, expected))
+        elif status == 304:
+            print("%s: up to date" % host)
+        elif status == 412:
+            print("%s: changed since %s was read, not updated" % (host, current))
+            failed += 1
+        else:
+            print("%s: failed with HTTP %d" % (host, status))
+            failed += 1
+    return failed
+
+
+if __name__ == "__main__":
+    sys.exit(main())
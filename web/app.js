@@ -0,0 +1,86 @@
+// Configuration form rendered from GET /config and saved with PUT /config
+(function () {
+    const form = document.getElementById('config');
+    const buttons = document.getElementById('buttons');
+    const status = document.getElementById('status');
+    const template = document.getElementById('button-template');
+
+    const TEXT_FIELDS = ['push', 'hold', 'doublePush'];
+    const VAR_FIELDS = ['min', 'max', 'value', 'step'];
+
+    function render(config) {
+        buttons.textContent = '';
+        config.buttons.forEach(function (button, i) {
+            const block = template.content.firstElementChild.cloneNode(true);
+            block.querySelector('h2').textContent = 'Button ' + (i + 1);
+            TEXT_FIELDS.forEach(function (field) {
+                block.querySelector('[name=' + field + ']').value = button[field];
+            });
+            block.querySelector('[name=repeatOnHold]').checked = button.repeatOnHold;
+            VAR_FIELDS.forEach(function (field) {
+                block.querySelector('[name=' + field + ']').value = button.var[field];
+            });
+            buttons.appendChild(block);
+        });
+        buttons.removeAttribute('aria-busy');
+    }
+
+    function read() {
+        return {
+            buttons: Array.prototype.map.call(buttons.children, function (block) {
+                const button = {};
+                TEXT_FIELDS.forEach(function (field) {
+                    button[field] = block.querySelector('[name=' + field + ']').value.trim();
+                });
+                button.repeatOnHold = block.querySelector('[name=repeatOnHold]').checked;
+                button.var = {};
+                VAR_FIELDS.forEach(function (field) {
+                    button.var[field] = parseInt(block.querySelector('[name=' + field + ']').value, 10) || 0;
+                });
+                return button;
+            })
+        };
+    }
+
+    function load() {
+        return fetch('/config')
+            .then(function (response) {
+                if (!response.ok) {
+                    throw new Error(response.status + ' ' + response.statusText);
+                }
+                return response.json();
+            })
+            .then(render)
+            .catch(function (error) {
+                status.textContent = 'Loading the configuration failed: ' + error.message;
+            });
+    }
+
+    form.addEventListener('submit', function (event) {
+        event.preventDefault();
+        status.textContent = 'Saving...';
+        fetch('/config', {
+            method: 'PUT',
+            headers: { 'Content-Type': 'application/json' },
+            body: JSON.stringify(read())
+        })
+            .then(function (response) {
+                if (response.status === 204) {
+                    status.textContent = 'Saved';
+                    return load();
+                }
+                if (response.status === 304) {
+                    status.textContent = 'No changes';
+                    return;
+                }
+                return response.text().then(function (message) {
+                    status.textContent = message;
+                });
+            })
+            .catch(function (error) {
+                status.textContent = 'Saving failed: ' + error.message;
+            });
+    });
+
+    load();
+})();